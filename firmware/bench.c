@@ -0,0 +1,256 @@
+/**
+ * @file    bench.c
+ * @author  Daniel Lockhead
+ * @date    2024
+ *
+ * @brief   Benchmark and soak test of the Pico Slave using the I2C master loopback
+ *
+ * @details The i2c1 controller is used as master on GP6 (SDA) and GP7 (SCL), wired to the slave pins
+ * GP20 (SDA) and GP21 (SCL) of the same board. Each run replays one command mix at one baud rate and
+ * print a single summary line with the transactions per second, the round-trip latency percentiles
+ * measured with the hardware timer and the error and NACK counts.
+ *
+ * @copyright Copyright (c) 2024, D.Lockhead. All rights reserved.
+ *
+ * This software is licensed under the BSD 3-Clause License.
+ * See the LICENSE file for more details.
+ */
+
+#include <pico/stdlib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "hardware/i2c.h"
+#include "bench.h"
+#include "userconfig.h"
+
+#ifndef BENCH_TRANSACTIONS
+#define BENCH_TRANSACTIONS 1000  // transactions per run, defined by cmake
+#endif
+
+#ifndef BENCH_BAUDRATE
+#define BENCH_BAUDRATE 0  // 0 = sweep all speed modes, otherwise baudrate used, defined by cmake
+#endif
+
+static_assert(BENCH_TRANSACTIONS > 0, "at least one transaction per run");
+static_assert(BENCH_BAUDRATE == 0 || (BENCH_BAUDRATE >= 10000 && BENCH_BAUDRATE <= 1000000),
+              "baudrate must be 0 or 10000 to 1000000");
+
+static const uint I2C_MASTER_SDA_PIN = 6;     /// Master SDA pin
+static const uint I2C_MASTER_SCL_PIN = 7;     /// Master SCL pins
+static const uint BENCH_TIMEOUT_US = 10000;   /// Timeout of one transfer
+static const uint8_t CMD_SET_SPEED = 102;     /// slave command to change I2C speed mode
+static const uint8_t CMD_CLEAR_TIMING = 112;  /// slave command to clear ISR timing statistics
+
+static const uint BENCH_SPEEDS[] = {100000, 400000, 1000000};  // index is the slave speed mode, fastest baudrate
+
+/// One step of a command mix
+typedef struct
+{
+  uint8_t cmd;       /// command byte
+  uint8_t data;      /// data byte, or argument written before a read
+  uint8_t read_len;  /// 0 = write, else number of bytes read back
+} bench_step_t;
+
+/// Command mix replayed in loop until the number of transactions is reached
+typedef struct
+{
+  const char* name;
+  const bench_step_t* steps;
+  uint count;
+} bench_mix_t;
+
+// pins used by the mixes must avoid the I2C pins (6, 7, 20, 21) and the Pico led (25)
+#if BENCH_MIX_CUSTOM
+static const bench_step_t MIX_CUSTOM[] = {BENCH_MIX_STEPS};  // SLAVE_BENCH_MIX of cmake
+
+static const bench_mix_t BENCH_MIXES[] = {
+    {"custom", MIX_CUSTOM, count_of(MIX_CUSTOM)},
+};
+#else
+static const bench_step_t MIX_WRITE[] = {{11, 2, 0}, {10, 2, 0}};
+static const bench_step_t MIX_READ[] = {{15, 2, 1}, {100, 0, 1}, {13, 0, 1}};
+static const bench_step_t MIX_MIXED[] = {{11, 2, 0}, {15, 2, 1}, {10, 2, 0}, {100, 0, 1}};
+static const bench_step_t MIX_SNAPSHOT[] = {{16, 0, 16}};
+
+static const bench_mix_t BENCH_MIXES[] = {
+    {"write", MIX_WRITE, count_of(MIX_WRITE)},
+    {"read", MIX_READ, count_of(MIX_READ)},
+    {"mixed", MIX_MIXED, count_of(MIX_MIXED)},
+    {"snapshot", MIX_SNAPSHOT, count_of(MIX_SNAPSHOT)},
+};
+#endif
+
+/// Result of one run
+typedef struct
+{
+  uint32_t errors;  /// timeout or short transfer
+  uint32_t nacks;   /// address or data not acknowledged
+  uint32_t elapsed_us;
+} bench_result_t;
+
+static uint16_t latency[BENCH_TRANSACTIONS];  // round-trip time of each transaction, in us
+
+/**
+ * @brief Set the up master object
+ *
+ */
+void bench_setup_master(void)
+{
+  gpio_init(I2C_MASTER_SDA_PIN);
+  gpio_set_function(I2C_MASTER_SDA_PIN, GPIO_FUNC_I2C);
+  // pull-ups are already active on slave side, this is just a fail-safe in case the wiring is faulty
+  gpio_pull_up(I2C_MASTER_SDA_PIN);
+
+  gpio_init(I2C_MASTER_SCL_PIN);
+  gpio_set_function(I2C_MASTER_SCL_PIN, GPIO_FUNC_I2C);
+  gpio_pull_up(I2C_MASTER_SCL_PIN);
+
+  i2c_init(i2c1, I2C_SLAVE_BAUDRATE);  // slave speed at boot
+}
+
+/**
+ * @brief Execute one transaction. A read is a single transaction: command and argument written,
+ *        repeated start, then the data read back.
+ *
+ * @param address slave address
+ * @param step    command to execute
+ * @param result  errors and nacks counters updated
+ * @return true   transaction completed
+ */
+static bool bench_transfer(uint8_t address, const bench_step_t* step, bench_result_t* result)
+{
+  uint8_t buf[2] = {step->cmd, step->data};
+  uint8_t rd[16];
+  int count;
+
+  count = i2c_write_timeout_us(i2c1, address, buf, sizeof(buf), step->read_len > 0, BENCH_TIMEOUT_US);
+  if (count == sizeof(buf) && step->read_len > 0)
+  {
+    count = i2c_read_timeout_us(i2c1, address, rd, step->read_len, false, BENCH_TIMEOUT_US);
+    if (count == step->read_len)
+    {
+      return true;
+    }
+  }
+  else if (count == sizeof(buf))
+  {
+    return true;
+  }
+
+  if (count == PICO_ERROR_GENERIC)
+  {
+    result->nacks++;
+  }
+  else
+  {
+    result->errors++;
+  }
+  return false;
+}
+
+/**
+ * @brief Slowest slave speed mode supporting a baudrate
+ *
+ * @param baud master baudrate, up to 1000000
+ * @return uint8_t speed mode index, see command 102
+ */
+static uint8_t bench_speed_mode(uint baud)
+{
+  uint8_t mode = 0;
+
+  while (mode < count_of(BENCH_SPEEDS) - 1 && baud > BENCH_SPEEDS[mode])
+  {
+    mode++;
+  }
+  return mode;
+}
+
+/**
+ * @brief Change the slave speed mode, then the master baudrate
+ *
+ * @param address slave address
+ * @param mode    speed mode index, see command 102
+ * @param baud    master baudrate, up to the fastest of the speed mode
+ * @return uint   actual master baudrate, 0 if the slave does not answer at the new speed
+ */
+static uint bench_set_speed(uint8_t address, uint8_t mode, uint baud)
+{
+  bench_step_t step = {CMD_SET_SPEED, mode, 0};
+  bench_result_t dummy = {0};
+
+  if (!bench_transfer(address, &step, &dummy))
+  {
+    return 0;
+  }
+  sleep_ms(2);  // slave apply the speed when the bus is idle
+  baud = i2c_set_baudrate(i2c1, baud);
+
+  step.read_len = 1;  // read back the speed mode at new speed
+  if (!bench_transfer(address, &step, &dummy))
+  {
+    return 0;
+  }
+  step.cmd = CMD_CLEAR_TIMING;  // slave ISR timing statistics start with the run
+  step.read_len = 0;
+  bench_transfer(address, &step, &dummy);
+  return baud;
+}
+
+static int compare_latency(const void* a, const void* b)
+{
+  return (int)*(const uint16_t*)a - (int)*(const uint16_t*)b;
+}
+
+/**
+ * @brief One run of a command mix, summary printed on one line
+ *
+ * @param address slave address
+ * @param mix     command mix to replay
+ * @param baud    actual baudrate, for the report only
+ */
+static void bench_mix(uint8_t address, const bench_mix_t* mix, uint baud)
+{
+  bench_result_t result = {0};
+  uint32_t run_start = time_us_32();
+
+  for (uint n = 0; n < BENCH_TRANSACTIONS; n++)
+  {
+    uint32_t start = time_us_32();
+    bench_transfer(address, &mix->steps[n % mix->count], &result);
+    uint32_t delta = time_us_32() - start;
+    latency[n] = delta > UINT16_MAX ? UINT16_MAX : delta;
+  }
+  result.elapsed_us = time_us_32() - run_start;
+
+  qsort(latency, BENCH_TRANSACTIONS, sizeof(latency[0]), compare_latency);
+
+  printf("BENCH mix=%s baud=%u n=%u tps=%lu p50=%u p90=%u p99=%u max=%u us err=%lu nack=%lu\n", mix->name, baud,
+         BENCH_TRANSACTIONS, (unsigned long)((uint64_t)BENCH_TRANSACTIONS * 1000000 / result.elapsed_us),
+         latency[(BENCH_TRANSACTIONS - 1) * 50 / 100], latency[(BENCH_TRANSACTIONS - 1) * 90 / 100],
+         latency[(BENCH_TRANSACTIONS - 1) * 99 / 100], latency[BENCH_TRANSACTIONS - 1], (unsigned long)result.errors,
+         (unsigned long)result.nacks);
+}
+
+void bench_run(uint8_t slave_address)
+{
+  for (uint8_t mode = 0; mode < count_of(BENCH_SPEEDS); mode++)
+  {
+    uint baud = BENCH_BAUDRATE != 0 ? BENCH_BAUDRATE : BENCH_SPEEDS[mode];
+
+    if (BENCH_BAUDRATE != 0 && mode != bench_speed_mode(BENCH_BAUDRATE))
+    {
+      continue;  // only one speed requested, run in the slowest slave mode supporting it
+    }
+    baud = bench_set_speed(slave_address, mode, baud);
+    if (baud == 0)
+    {
+      i2c_set_baudrate(i2c1, I2C_SLAVE_BAUDRATE);  // slave may have kept its boot speed
+      printf("BENCH mode=%u speed change failed\n", mode);
+      continue;
+    }
+    for (uint m = 0; m < count_of(BENCH_MIXES); m++)
+    {
+      bench_mix(slave_address, &BENCH_MIXES[m], baud);
+    }
+  }
+}
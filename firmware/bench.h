@@ -0,0 +1,41 @@
+/**
+ * @file    bench.h
+ * @author  Daniel Lockhead
+ * @date    2024
+ *
+ * @brief   Benchmark and soak test of the Pico Slave using the I2C master loopback
+ *
+ * @copyright Copyright (c) 2024, D.Lockhead. All rights reserved.
+ *
+ * This software is licensed under the BSD 3-Clause License.
+ * See the LICENSE file for more details.
+ */
+
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <pico/stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Configure i2c1 as master on the loopback pins (GP6 = SDA, GP7 = SCL).
+ *        GP6 must be wired to the slave SDA and GP7 to the slave SCL.
+ */
+void bench_setup_master(void);
+
+/**
+ * @brief Run all command mixes at all configured baud rates, one summary line printed per run.
+ *        Blocking, each run executes BENCH_TRANSACTIONS transactions.
+ *
+ * @param slave_address I2C address of the slave under test
+ */
+void bench_run(uint8_t slave_address);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // _BENCH_H_
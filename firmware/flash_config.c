@@ -0,0 +1,94 @@
+/**
+ * @file    flash_config.c
+ * @author  Daniel Lockhead
+ * @date    2024
+ *
+ * @brief   Power-on configuration saved in the last sector of the flash
+ *
+ * @details The record is written on one flash page at the beginning of the last sector, which is not used by
+ * the program image. It is read back through the XIP window at boot, so the configuration is applied in a few
+ * microseconds instead of the hundreds of I2C transactions needed to restore it from the master.
+ *
+ * @copyright Copyright (c) 2024, D.Lockhead. All rights reserved.
+ *
+ * This software is licensed under the BSD 3-Clause License.
+ * See the LICENSE file for more details.
+ */
+
+#include <pico/stdlib.h>
+#include <string.h>
+#include "hardware/flash.h"
+#include "pico/flash.h"
+#include "flash_config.h"
+
+#define FLASH_CONFIG_OFFSET (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE)  /**< Flash offset of the reserved sector. */
+#define FLASH_CONFIG_TIMEOUT_MS 100                                       /**< Maximum wait for the other core lockout. */
+
+static_assert(sizeof(flash_config_t) <= FLASH_PAGE_SIZE, "flash config record must fit in one page");
+
+static uint8_t page[FLASH_PAGE_SIZE];  // record padded to one page, must be in RAM while the flash is written
+
+/**
+ * @brief CRC-32 (IEEE 802.3, reflected), bitwise, the record is small.
+ *
+ * @param data  bytes to check
+ * @param len   number of bytes
+ * @return uint32_t CRC
+ */
+static uint32_t crc32(const uint8_t* data, size_t len)
+{
+  uint32_t crc = 0xFFFFFFFFu;
+
+  while (len--)
+  {
+    crc ^= *data++;
+    for (uint bit = 0; bit < 8; bit++)
+    {
+      crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+    }
+  }
+  return ~crc;
+}
+
+/**
+ * @brief Erase the sector, then program the page when data is defined. Called by flash_safe_execute(),
+ *        the XIP flash is not accessible during the call.
+ *
+ * @param data  page to write, NULL to erase only
+ */
+static void __not_in_flash_func(flash_config_program)(void* data)
+{
+  flash_range_erase(FLASH_CONFIG_OFFSET, FLASH_SECTOR_SIZE);
+  if (data != NULL)
+  {
+    flash_range_program(FLASH_CONFIG_OFFSET, (const uint8_t*)data, FLASH_PAGE_SIZE);
+  }
+}
+
+bool flash_config_load(flash_config_t* cfg)
+{
+  memcpy(cfg, (const void*)(XIP_BASE + FLASH_CONFIG_OFFSET), sizeof(*cfg));
+
+  if (cfg->magic != FLASH_CONFIG_MAGIC || cfg->version != FLASH_CONFIG_VERSION)
+  {
+    return false;  // erased sector or old layout
+  }
+  return cfg->crc == crc32((const uint8_t*)cfg, offsetof(flash_config_t, crc));
+}
+
+int flash_config_save(flash_config_t* cfg)
+{
+  cfg->magic = FLASH_CONFIG_MAGIC;
+  cfg->version = FLASH_CONFIG_VERSION;
+  cfg->reserved = 0;
+  cfg->crc = crc32((const uint8_t*)cfg, offsetof(flash_config_t, crc));
+
+  memset(page, 0xFF, sizeof(page));  // erased state, unused bytes of the page are left unprogrammed
+  memcpy(page, cfg, sizeof(*cfg));
+  return flash_safe_execute(flash_config_program, page, FLASH_CONFIG_TIMEOUT_MS);
+}
+
+int flash_config_erase(void)
+{
+  return flash_safe_execute(flash_config_program, NULL, FLASH_CONFIG_TIMEOUT_MS);
+}
@@ -0,0 +1,69 @@
+/**
+ * @file    flash_config.h
+ * @author  Daniel Lockhead
+ * @date    2024
+ *
+ * @brief   Power-on configuration saved in the last sector of the flash
+ *
+ * @copyright Copyright (c) 2024, D.Lockhead. All rights reserved.
+ *
+ * This software is licensed under the BSD 3-Clause License.
+ * See the LICENSE file for more details.
+ */
+
+#ifndef _FLASH_CONFIG_H_
+#define _FLASH_CONFIG_H_
+
+#include <pico/stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FLASH_CONFIG_MAGIC 0x47464349u /**< "ICFG", record present in the sector. */
+#define FLASH_CONFIG_VERSION 1         /**< Layout of the record, a record of another version is ignored. */
+
+/**
+ * @brief GPIO and pad state applied at boot
+ */
+typedef struct
+{
+  uint32_t magic;                   /// FLASH_CONFIG_MAGIC
+  uint8_t version;                  /// FLASH_CONFIG_VERSION
+  uint8_t i2c_add;                  /// I2C address of the slave that saved the record
+  uint16_t reserved;
+  uint32_t gpio_out;                /// SIO output register
+  uint32_t gpio_dir;                /// SIO direction register, 1 = output
+  uint32_t pads[NUM_BANK0_GPIOS];   /// Pad control registers: drive strength, pulls, slew rate, input enable
+  uint32_t crc;                     /// CRC-32 of the previous fields
+} flash_config_t;
+
+/**
+ * @brief Read the record saved in flash.
+ *
+ * @param cfg  record copied from flash
+ * @return true magic, version and CRC are valid
+ */
+bool flash_config_load(flash_config_t* cfg);
+
+/**
+ * @brief Erase the sector and write the record, CRC is computed here. Both cores are stopped during
+ *        the erase and program (about 50 ms), the other core must be initialised with flash_safe_execute_core_init().
+ *
+ * @param cfg  record to write, magic and version are set here
+ * @return int PICO_OK, or the error of flash_safe_execute()
+ */
+int flash_config_save(flash_config_t* cfg);
+
+/**
+ * @brief Erase the sector, the default configuration of the I2C address is used at next boot.
+ *
+ * @return int PICO_OK, or the error of flash_safe_execute()
+ */
+int flash_config_erase(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // _FLASH_CONFIG_H_
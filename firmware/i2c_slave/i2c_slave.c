@@ -5,6 +5,8 @@
  */
 
 #include <i2c_slave.h>
+#include <hardware/clocks.h>
+#include <hardware/dma.h>
 #include <hardware/irq.h>
 
 
@@ -15,16 +17,88 @@ typedef struct i2c_slave_t {
     i2c_inst_t *i2c;               /**< I2C instance. */
     i2c_slave_handler_t handler;   /**< I2C slave event handler. */
     bool transfer_in_progress;     /**< Transfer status flag. */
+    bool general_call;             /**< Transfer in progress addressed with the general call address. */
+    uint8_t tx_threshold;          /**< Tx FIFO level raising I2C_SLAVE_TX_LOW, 0 if not used. */
+    int dma_rx;                    /**< DMA channel Rx FIFO to buffer, -1 if DMA not initialized. */
+    int dma_sink;                  /**< DMA channel draining the Rx FIFO once the buffer is full. */
+    int dma_tx;                    /**< DMA channel buffer to Tx FIFO. */
+    bool dma_rx_active;            /**< Write transfer received by DMA. */
+    bool dma_tx_active;            /**< Read transfer sent by DMA. */
+    size_t dma_rx_len;             /**< Size of the Rx buffer. */
+    size_t dma_received;           /**< Bytes received by DMA in the last transfer. */
+    uint8_t dma_sink_byte;         /**< Destination of the discarded bytes. */
+    uint16_t dma_tx_buf[I2C_SLAVE_DMA_TX_MAX]; /**< Data sent by DMA, one IC_DATA_CMD write per byte. */
 } i2c_slave_t;
 
+#define I2C_SLAVE_DMA_SINK_COUNT 0xFFFFFFFFu
+#define I2C_SLAVE_DMA_DRAIN_WAIT 64 // loops waiting for the DMA to empty the Rx FIFO, a byte takes a few cycles
+
 
 static i2c_slave_t i2c_slaves[2];
 
+static inline void finish_dma(i2c_slave_t *slave) {
+    i2c_hw_t *hw = i2c_get_hw(slave->i2c);
+
+    if (slave->dma_rx_active) {
+        dma_channel_hw_t *rx = dma_channel_hw_addr(slave->dma_rx);
+
+        // the Stop or Restart is detected after the last byte is in the Rx FIFO, give the DMA time to move it
+        for (uint i = 0; i < I2C_SLAVE_DMA_DRAIN_WAIT && hw->rxflr != 0; i++) {
+            tight_loop_contents();
+        }
+        dma_channel_abort(slave->dma_rx);
+        dma_channel_abort(slave->dma_sink);
+        uint32_t left = rx->transfer_count;
+        slave->dma_received = slave->dma_rx_len - left;
+        if (left == 0) {
+            // the sink count is only reloaded when the chain is triggered by the end of the buffer
+            slave->dma_received += I2C_SLAVE_DMA_SINK_COUNT - dma_channel_hw_addr(slave->dma_sink)->transfer_count;
+        }
+        // bytes not moved by the DMA in time are copied here
+        uint8_t *dst = (uint8_t *)(uintptr_t)rx->write_addr;
+        while (hw->rxflr != 0) {
+            uint8_t byte = (uint8_t)hw->data_cmd;
+            if (left != 0) {
+                *dst++ = byte;
+                left--;
+            }
+            slave->dma_received++;
+        }
+        slave->dma_rx_active = false;
+        hw_set_bits(&hw->intr_mask, I2C_IC_INTR_MASK_M_RX_FULL_BITS);
+        slave->handler(slave->i2c, I2C_SLAVE_DMA_RECEIVE);
+    }
+    if (slave->dma_tx_active) {
+        dma_channel_abort(slave->dma_tx);
+        slave->dma_tx_active = false;
+    }
+}
+
+static inline void drain_rx_fifo(i2c_slave_t *slave) {
+    i2c_hw_t *hw = i2c_get_hw(slave->i2c);
+    uint level = hw->rxflr;
+
+    // bytes below the Rx threshold are delivered before the end of the transfer
+    while (level != 0 && !slave->dma_rx_active) {
+        slave->transfer_in_progress = true;
+        slave->handler(slave->i2c, I2C_SLAVE_RECEIVE);
+        uint remaining = hw->rxflr;
+        if (remaining >= level) {
+            break; // nothing read by the handler
+        }
+        level = remaining;
+    }
+}
+
 static inline void finish_transfer(i2c_slave_t *slave) {
+    drain_rx_fifo(slave);
     if (slave->transfer_in_progress) {
+        hw_clear_bits(&i2c_get_hw(slave->i2c)->intr_mask, I2C_IC_INTR_MASK_M_TX_EMPTY_BITS);
+        finish_dma(slave);
         slave->handler(slave->i2c, I2C_SLAVE_FINISH);
         slave->transfer_in_progress = false;
     }
+    slave->general_call = false;
 }
 
 static void __not_in_flash_func(i2c_slave_irq_handler)(i2c_slave_t *slave) {
@@ -37,12 +111,18 @@ static void __not_in_flash_func(i2c_slave_irq_handler)(i2c_slave_t *slave) {
     }
     if (intr_stat & I2C_IC_INTR_STAT_R_TX_ABRT_BITS) {
         hw->clr_tx_abrt;
+        slave->handler(i2c, I2C_SLAVE_TX_ABORT);
         finish_transfer(slave);
     }
     if (intr_stat & I2C_IC_INTR_STAT_R_START_DET_BITS) {
         hw->clr_start_det;
         finish_transfer(slave);
     }
+    if (intr_stat & I2C_IC_INTR_STAT_R_GEN_CALL_BITS) {
+        // raised on the address ACK, after the end of the previous transfer and before the first data byte
+        hw->clr_gen_call;
+        slave->general_call = true;
+    }
     if (intr_stat & I2C_IC_INTR_STAT_R_STOP_DET_BITS) {
         hw->clr_stop_det;
         finish_transfer(slave);
@@ -54,7 +134,19 @@ static void __not_in_flash_func(i2c_slave_irq_handler)(i2c_slave_t *slave) {
     if (intr_stat & I2C_IC_INTR_STAT_R_RD_REQ_BITS) {
         hw->clr_rd_req;
         slave->transfer_in_progress = true;
-        slave->handler(i2c, I2C_SLAVE_REQUEST);
+        if (!(slave->dma_tx_active && dma_channel_hw_addr(slave->dma_tx)->transfer_count != 0)) {
+            slave->handler(i2c, I2C_SLAVE_REQUEST);
+        }
+        if (slave->tx_threshold != 0 && !slave->dma_tx_active) {
+            hw_set_bits(&hw->intr_mask, I2C_IC_INTR_MASK_M_TX_EMPTY_BITS); // refill before the Tx FIFO is empty
+        }
+    }
+    if ((intr_stat & I2C_IC_INTR_STAT_R_TX_EMPTY_BITS) && (hw->intr_mask & I2C_IC_INTR_MASK_M_TX_EMPTY_BITS)) {
+        slave->handler(i2c, I2C_SLAVE_TX_LOW);
+        if (hw->txflr <= slave->tx_threshold) {
+            // no more data, TX_EMPTY is a level interrupt
+            hw_clear_bits(&hw->intr_mask, I2C_IC_INTR_MASK_M_TX_EMPTY_BITS);
+        }
     }
 }
 
@@ -74,13 +166,22 @@ void i2c_slave_init(i2c_inst_t *i2c, uint8_t address, i2c_slave_handler_t handle
     i2c_slave_t *slave = &i2c_slaves[i2c_index];
     slave->i2c = i2c;
     slave->handler = handler;
+    slave->tx_threshold = 0;
+    slave->general_call = false;
+    slave->dma_rx = -1;
+    slave->dma_rx_active = false;
+    slave->dma_tx_active = false;
 
     // Note: The I2C slave does clock stretching implicitly after a RD_REQ, while the Tx FIFO is empty.
-    // There is also an option to enable clock stretching while the Rx FIFO is full, but we leave it
-    // disabled since the Rx FIFO should never fill up (unless slave->handler() is way too slow).
+    // Clock stretching while the Rx FIFO is full is also enabled, so bytes are not dropped at 400 kb/s
+    // and 1 Mb/s when slave->handler() is too slow to keep up with the master.
     i2c_set_slave_mode(i2c, true, address);
 
     i2c_hw_t *hw = i2c_get_hw(i2c);
+    hw->enable = 0;
+    hw_set_bits(&hw->con, I2C_IC_CON_RX_FIFO_FULL_HLD_CTRL_BITS);
+    hw->enable = 1;
+
     // unmask necessary interrupts
     hw->intr_mask = I2C_IC_INTR_MASK_M_RX_FULL_BITS | I2C_IC_INTR_MASK_M_RD_REQ_BITS | I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS | I2C_IC_INTR_MASK_M_STOP_DET_BITS | I2C_IC_INTR_MASK_M_START_DET_BITS;
 
@@ -97,6 +198,14 @@ void i2c_slave_deinit(i2c_inst_t *i2c) {
     i2c_slave_t *slave = &i2c_slaves[i2c_index];
     assert(slave->i2c == i2c); // should be called after i2c_slave_init()
 
+    if (slave->dma_rx >= 0) {
+        finish_dma(slave);
+        dma_channel_unclaim(slave->dma_rx);
+        dma_channel_unclaim(slave->dma_sink);
+        dma_channel_unclaim(slave->dma_tx);
+        slave->dma_rx = -1;
+    }
+
     slave->i2c = NULL;
     slave->handler = NULL;
     slave->transfer_in_progress = false;
@@ -108,5 +217,156 @@ void i2c_slave_deinit(i2c_inst_t *i2c) {
     i2c_hw_t *hw = i2c_get_hw(i2c);
     hw->intr_mask = I2C_IC_INTR_MASK_RESET;
 
+    hw->enable = 0;
+    hw_clear_bits(&hw->con, I2C_IC_CON_RX_FIFO_FULL_HLD_CTRL_BITS);
+    hw->ack_general_call = 0;
     i2c_set_slave_mode(i2c, false, 0);
 }
+
+void i2c_slave_set_general_call(i2c_inst_t *i2c, bool enable) {
+    assert(i2c == i2c0 || i2c == i2c1);
+
+    i2c_hw_t *hw = i2c_get_hw(i2c);
+    hw->ack_general_call = enable ? I2C_IC_ACK_GENERAL_CALL_ACK_GEN_CALL_BITS : 0;
+    if (enable) {
+        hw_set_bits(&hw->intr_mask, I2C_IC_INTR_MASK_M_GEN_CALL_BITS);
+    } else {
+        hw_clear_bits(&hw->intr_mask, I2C_IC_INTR_MASK_M_GEN_CALL_BITS);
+    }
+}
+
+bool __not_in_flash_func(i2c_slave_is_general_call)(i2c_inst_t *i2c) {
+    return i2c_slaves[i2c_hw_index(i2c)].general_call;
+}
+
+void i2c_slave_set_speed(i2c_inst_t *i2c, uint baudrate) {
+    assert(i2c == i2c0 || i2c == i2c1);
+
+    i2c_hw_t *hw = i2c_get_hw(i2c);
+    uint freq_in = clock_get_hz(clk_sys);
+
+    // Spike suppression of 50 ns, as required by the I2C specification for Fast-mode and Fast-mode Plus.
+    uint spklen = (freq_in + 19999999) / 20000000;
+
+    // SDA is held after the SCL falling edge to bridge its undefined region: 300 ns up to Fast-mode,
+    // 120 ns for Fast-mode Plus. Same values as used by the SDK in master mode.
+    uint sda_tx_hold_count;
+    if (baudrate < 1000000) {
+        sda_tx_hold_count = ((freq_in * 3) / 10000000) + 1;
+    } else {
+        sda_tx_hold_count = ((freq_in * 3) / 25000000) + 1;
+    }
+
+    // IC_FS_SPKLEN can only be written while the controller is disabled
+    bool enabled = hw->enable & I2C_IC_ENABLE_ENABLE_BITS;
+    hw->enable = 0;
+    hw->fs_spklen = spklen;
+    hw_write_masked(&hw->sda_hold, sda_tx_hold_count << I2C_IC_SDA_HOLD_IC_SDA_TX_HOLD_LSB, I2C_IC_SDA_HOLD_IC_SDA_TX_HOLD_BITS);
+    if (enabled) {
+        hw->enable = 1;
+    }
+}
+
+void i2c_slave_set_fifo_thresholds(i2c_inst_t *i2c, uint8_t rx_threshold, uint8_t tx_threshold) {
+    assert(i2c == i2c0 || i2c == i2c1);
+    assert(rx_threshold >= 1 && rx_threshold <= 16);
+    assert(tx_threshold <= 15);
+
+    i2c_slave_t *slave = &i2c_slaves[i2c_hw_index(i2c)];
+    i2c_hw_t *hw = i2c_get_hw(i2c);
+
+    // RX_FULL is raised when the Rx FIFO level is above IC_RX_TL, TX_EMPTY when the Tx FIFO level is at or below IC_TX_TL
+    hw->rx_tl = rx_threshold - 1;
+    hw->tx_tl = tx_threshold;
+    slave->tx_threshold = tx_threshold;
+}
+
+bool i2c_slave_dma_init(i2c_inst_t *i2c) {
+    assert(i2c == i2c0 || i2c == i2c1);
+
+    i2c_slave_t *slave = &i2c_slaves[i2c_hw_index(i2c)];
+    assert(slave->i2c == i2c); // should be called after i2c_slave_init()
+
+    if (slave->dma_rx >= 0) {
+        return true;
+    }
+    int rx = dma_claim_unused_channel(false);
+    int sink = dma_claim_unused_channel(false);
+    int tx = dma_claim_unused_channel(false);
+    if (rx < 0 || sink < 0 || tx < 0) {
+        if (rx >= 0) dma_channel_unclaim(rx);
+        if (sink >= 0) dma_channel_unclaim(sink);
+        if (tx >= 0) dma_channel_unclaim(tx);
+        return false;
+    }
+    slave->dma_sink = sink;
+    slave->dma_tx = tx;
+
+    // DREQ while at least one byte in the Rx FIFO, and while the Tx FIFO is half empty
+    i2c_hw_t *hw = i2c_get_hw(i2c);
+    hw->dma_rdlr = 0;
+    hw->dma_tdlr = 8;
+    hw->dma_cr = I2C_IC_DMA_CR_TDMAE_BITS | I2C_IC_DMA_CR_RDMAE_BITS;
+
+    slave->dma_rx = rx; // DMA available from now
+    return true;
+}
+
+bool __not_in_flash_func(i2c_slave_dma_receive)(i2c_inst_t *i2c, uint8_t *buf, size_t len) {
+    i2c_slave_t *slave = &i2c_slaves[i2c_hw_index(i2c)];
+    i2c_hw_t *hw = i2c_get_hw(i2c);
+
+    if (slave->dma_rx < 0 || len == 0) {
+        return false;
+    }
+
+    // buffer full: DMA chained to the sink channel, the rest of the transfer is discarded
+    dma_channel_config c = dma_channel_get_default_config(slave->dma_sink);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, i2c_get_dreq(i2c, false));
+    dma_channel_configure(slave->dma_sink, &c, &slave->dma_sink_byte, &hw->data_cmd, I2C_SLAVE_DMA_SINK_COUNT, false);
+
+    c = dma_channel_get_default_config(slave->dma_rx);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_dreq(&c, i2c_get_dreq(i2c, false));
+    channel_config_set_chain_to(&c, slave->dma_sink);
+
+    hw_clear_bits(&hw->intr_mask, I2C_IC_INTR_MASK_M_RX_FULL_BITS);
+    slave->dma_rx_len = len;
+    slave->dma_received = 0;
+    slave->dma_rx_active = true;
+    dma_channel_configure(slave->dma_rx, &c, buf, &hw->data_cmd, len, true);
+    return true;
+}
+
+size_t __not_in_flash_func(i2c_slave_dma_received)(i2c_inst_t *i2c) {
+    return i2c_slaves[i2c_hw_index(i2c)].dma_received;
+}
+
+bool __not_in_flash_func(i2c_slave_dma_send)(i2c_inst_t *i2c, const uint8_t *buf, size_t len) {
+    i2c_slave_t *slave = &i2c_slaves[i2c_hw_index(i2c)];
+    i2c_hw_t *hw = i2c_get_hw(i2c);
+
+    if (slave->dma_rx < 0 || len == 0 || len > I2C_SLAVE_DMA_TX_MAX) {
+        return false;
+    }
+
+    // 8 bit writes are replicated on all byte lanes of data_cmd: data bits 0-2 would land in CMD, STOP and
+    // RESTART, and CMD = 1 aborts the slave transmit. Each byte is written as a 16 bit word, upper bits clear.
+    for (size_t i = 0; i < len; i++) {
+        slave->dma_tx_buf[i] = buf[i];
+    }
+    dma_channel_config c = dma_channel_get_default_config(slave->dma_tx);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_16);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, i2c_get_dreq(i2c, true));
+
+    slave->dma_tx_active = true;
+    dma_channel_configure(slave->dma_tx, &c, &hw->data_cmd, slave->dma_tx_buf, len, true);
+    return true;
+}
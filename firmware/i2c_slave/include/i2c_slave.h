@@ -26,6 +26,9 @@ typedef enum i2c_slave_event_t
     I2C_SLAVE_RECEIVE, /**< Data from master is available for reading. Slave must read from Rx FIFO. */
     I2C_SLAVE_REQUEST, /**< Master is requesting data. Slave must write into Tx FIFO. */
     I2C_SLAVE_FINISH, /**< Master has sent a Stop or Restart signal. Slave may prepare for the next transfer. */
+    I2C_SLAVE_DMA_RECEIVE, /**< Data received by DMA is available in the buffer, sent once before I2C_SLAVE_FINISH. */
+    I2C_SLAVE_TX_LOW, /**< Tx FIFO level is at the threshold during a read. Slave may write more data into Tx FIFO. */
+    I2C_SLAVE_TX_ABORT, /**< Transmit aborted, data left in Tx FIFO was flushed. Sent before I2C_SLAVE_FINISH. */
 } i2c_slave_event_t;
 
 /**
@@ -35,6 +38,8 @@ typedef enum i2c_slave_event_t
  * Avoid blocking inside the handler and split large data transfers across multiple calls for best results.
  * When sending data to master, up to `i2c_get_write_available()` bytes can be written without blocking.
  * When receiving data from master, up to `i2c_get_read_available()` bytes can be read without blocking.
+ * With a Rx threshold greater than 1, the handler should drain all the available bytes in one call. The bytes
+ * below the threshold are delivered with I2C_SLAVE_RECEIVE on the Stop or Restart, before I2C_SLAVE_FINISH.
  * 
  * \param i2c Slave I2C instance.
  * \param event Event type.
@@ -51,6 +56,102 @@ typedef void (*i2c_slave_handler_t)(i2c_inst_t *i2c, i2c_slave_event_t event);
  */
 void i2c_slave_init(i2c_inst_t *i2c, uint8_t address, i2c_slave_handler_t handler);
 
+/**
+ * \brief Adjust the spike suppression and SDA hold timings of a slave I2C instance to the bus speed.
+ *
+ * The master drives the clock, but the slave filter and data hold time must match the speed mode used
+ * by the master (Standard-mode, Fast-mode or Fast-mode Plus). Must be called while the bus is idle.
+ *
+ * \param i2c I2C instance.
+ * \param baudrate Bus speed used by the master in Hz (100000, 400000 or 1000000).
+ */
+void i2c_slave_set_speed(i2c_inst_t *i2c, uint baudrate);
+
+/**
+ * \brief Set the Rx and Tx FIFO thresholds of a slave I2C instance.
+ *
+ * By default I2C_SLAVE_RECEIVE is raised for each byte received, and the Tx FIFO is refilled only on
+ * I2C_SLAVE_REQUEST, when it is empty and the clock is stretched.
+ *
+ * \param i2c I2C instance.
+ * \param rx_threshold Number of bytes in Rx FIFO raising I2C_SLAVE_RECEIVE, 1 to 16.
+ * \param tx_threshold Tx FIFO level raising I2C_SLAVE_TX_LOW during a read, 1 to 15. 0 to disable.
+ */
+void i2c_slave_set_fifo_thresholds(i2c_inst_t *i2c, uint8_t rx_threshold, uint8_t tx_threshold);
+
+/**
+ * \brief Acknowledge the general call address (0x00) on a slave I2C instance.
+ *
+ * The data of a general call is received as a write to the slave address, i2c_slave_is_general_call()
+ * tells the handler which address was used. General call is disabled after i2c_slave_init().
+ *
+ * \param i2c I2C instance.
+ * \param enable true to acknowledge the general call address.
+ */
+void i2c_slave_set_general_call(i2c_inst_t *i2c, bool enable);
+
+/**
+ * \brief Check if the current transfer is addressed with the general call address.
+ *
+ * Valid on I2C_SLAVE_RECEIVE, I2C_SLAVE_DMA_RECEIVE and I2C_SLAVE_FINISH.
+ *
+ * \param i2c I2C instance.
+ * \return true if the master used the general call address.
+ */
+bool i2c_slave_is_general_call(i2c_inst_t *i2c);
+
+/**
+ * \brief Claim the DMA channels used for bulk transfers of a slave I2C instance.
+ *
+ * Three channels are claimed: Rx FIFO to buffer, Rx FIFO drain when the buffer is full, and buffer to Tx FIFO.
+ * Must be called after i2c_slave_init(), on the same core.
+ *
+ * \param i2c I2C instance.
+ * \return true if the channels are available.
+ */
+bool i2c_slave_dma_init(i2c_inst_t *i2c);
+
+/**
+ * \brief Receive the rest of the current write transfer into a buffer by DMA.
+ *
+ * Called from the handler on I2C_SLAVE_RECEIVE. The Rx FIFO interrupt is masked until the Stop or Restart,
+ * then the handler is called once with I2C_SLAVE_DMA_RECEIVE. Bytes past `len` are acknowledged and discarded,
+ * so the master is never stalled.
+ *
+ * \param i2c I2C instance.
+ * \param buf Destination buffer, must stay valid until I2C_SLAVE_FINISH.
+ * \param len Size of the buffer.
+ * \return true if the transfer is handled by DMA, false if DMA is not initialized or len is 0.
+ */
+bool i2c_slave_dma_receive(i2c_inst_t *i2c, uint8_t *buf, size_t len);
+
+/**
+ * \brief Number of bytes received by DMA in the last transfer, including the bytes discarded.
+ *
+ * Valid on I2C_SLAVE_DMA_RECEIVE. The buffer is full when the result is greater or equal to `len`.
+ *
+ * \param i2c I2C instance.
+ * \return size_t Number of bytes written by the master.
+ */
+size_t i2c_slave_dma_received(i2c_inst_t *i2c);
+
+/**
+ * \brief Send a buffer to the master by DMA.
+ *
+ * Called from the handler on I2C_SLAVE_REQUEST. The handler is not called again with I2C_SLAVE_REQUEST until
+ * the whole buffer is in the Tx FIFO, so the end of data can be handled as usual. DMA is stopped on the Stop or
+ * Restart, the bytes not read by the master are flushed by the hardware. The buffer is copied as 16 bit words
+ * with the CMD, STOP and RESTART bits clear, a byte write to IC_DATA_CMD would set them with the data bits.
+ *
+ * \param i2c I2C instance.
+ * \param buf Source buffer, copied before the call returns.
+ * \param len Number of bytes to send, up to I2C_SLAVE_DMA_TX_MAX.
+ * \return true if the transfer is handled by DMA, false if DMA is not initialized, len is 0 or too long.
+ */
+#define I2C_SLAVE_DMA_TX_MAX 128 ///< Longest buffer sent by i2c_slave_dma_send().
+
+bool i2c_slave_dma_send(i2c_inst_t *i2c, const uint8_t *buf, size_t len);
+
 /**
  * \brief Restore I2C instance to master mode.
  *
@@ -0,0 +1,209 @@
+/**
+ * @file    port_pio.c
+ * @author  Daniel Lockhead
+ * @date    2024
+ *
+ * @brief   PIO pattern output and capture on the 8 bit ports
+ *
+ * @details One state machine of pio0 output a RAM buffer on the 8 pins of a port, or sample the port into
+ * the buffer, at a fixed rate set by an integer clock divider. The bytes are moved between the buffer and the
+ * PIO FIFO by DMA, so the transfer is not disturbed by the I2C interrupt. For a repeated pattern, a second DMA
+ * channel reloads the read address of the data channel at the end of the buffer, without gap in the output.
+ *
+ * @copyright Copyright (c) 2024, D.Lockhead. All rights reserved.
+ *
+ * This software is licensed under the BSD 3-Clause License.
+ * See the LICENSE file for more details.
+ */
+
+#include <pico/stdlib.h>
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/pio.h"
+#include "port_pio.h"
+#include "port_pio.pio.h"
+
+#define PORT_PIO_CYCLES 2  /**< PIO clock cycles per byte, same for all programs. */
+
+/// Program and default configuration, index: capture * 2 + strobe
+static const struct
+{
+  const pio_program_t* program;
+  pio_sm_config (*get_config)(uint offset);
+} PROGRAMS[] = {
+    {&port_out_program, port_out_program_get_default_config},
+    {&port_out_strobe_program, port_out_strobe_program_get_default_config},
+    {&port_in_program, port_in_program_get_default_config},
+    {&port_in_strobe_program, port_in_strobe_program_get_default_config},
+};
+
+static struct
+{
+  PIO pio;
+  uint sm;
+  uint data_chan;                /// DMA between buffer and FIFO
+  uint ctrl_chan;                /// DMA reloading data_chan read address, repeated pattern
+  const pio_program_t* program;  /// program loaded, NULL when stopped
+  uint offset;                   /// program location in instruction memory
+  uint base_pin;
+  bool capture;
+  bool strobe;
+  bool repeat;
+  uint32_t len;
+  uint32_t count;                /// bytes transferred by the last one-shot transfer, when stopped
+  const uint8_t* read_addr;      /// source of the control channel
+} port;
+
+void port_pio_init(void)
+{
+  port.pio = pio0;
+  port.sm = (uint)pio_claim_unused_sm(port.pio, true);
+  port.data_chan = (uint)dma_claim_unused_channel(true);
+  port.ctrl_chan = (uint)dma_claim_unused_channel(true);
+  port.program = NULL;
+}
+
+/**
+ * @brief Configure the DMA channels, data channel is started
+ *
+ * @param cfg transfer configuration
+ */
+static void port_pio_dma_start(const port_pio_config_t* cfg)
+{
+  dma_channel_config dc = dma_channel_get_default_config(port.data_chan);
+  channel_config_set_transfer_data_size(&dc, DMA_SIZE_8);
+  channel_config_set_high_priority(&dc, true);
+  channel_config_set_dreq(&dc, pio_get_dreq(port.pio, port.sm, !cfg->capture));
+
+  if (cfg->capture)
+  {
+    channel_config_set_read_increment(&dc, false);
+    channel_config_set_write_increment(&dc, true);
+    dma_channel_configure(port.data_chan, &dc, cfg->buf, &port.pio->rxf[port.sm], cfg->len, true);
+    return;
+  }
+
+  channel_config_set_read_increment(&dc, true);
+  channel_config_set_write_increment(&dc, false);
+  if (cfg->repeat)
+  {
+    dma_channel_config cc = dma_channel_get_default_config(port.ctrl_chan);
+    channel_config_set_transfer_data_size(&cc, DMA_SIZE_32);
+    channel_config_set_read_increment(&cc, false);
+    channel_config_set_write_increment(&cc, false);
+
+    port.read_addr = cfg->buf;
+    dma_channel_configure(port.ctrl_chan, &cc, &dma_channel_hw_addr(port.data_chan)->al3_read_addr_trig,
+                          &port.read_addr, 1, false);
+    channel_config_set_chain_to(&dc, port.ctrl_chan);  // restart from the beginning of the pattern
+  }
+  dma_channel_configure(port.data_chan, &dc, &port.pio->txf[port.sm], cfg->buf, cfg->len, true);
+}
+
+uint32_t port_pio_start(const port_pio_config_t* cfg)
+{
+  uint index = (cfg->capture ? 2 : 0) + (cfg->strobe ? 1 : 0);
+  uint32_t clk = clock_get_hz(clk_sys);
+  uint32_t div;
+
+  port_pio_stop();
+
+  port.program = PROGRAMS[index].program;
+  port.offset = pio_add_program(port.pio, port.program);
+  port.base_pin = cfg->base_pin;
+  port.capture = cfg->capture;
+  port.strobe = cfg->strobe;
+  port.repeat = cfg->repeat && !cfg->capture;
+  port.len = cfg->len;
+
+  pio_sm_config c = PROGRAMS[index].get_config(port.offset);
+  if (cfg->capture)
+  {
+    sm_config_set_in_pins(&c, cfg->base_pin);
+    sm_config_set_in_shift(&c, false, true, 8);  // byte in bits 7:0 of the FIFO
+    sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_RX);
+  }
+  else
+  {
+    sm_config_set_out_pins(&c, cfg->base_pin, 8);
+    sm_config_set_out_shift(&c, true, true, 8);  // byte replicated on the 4 lanes by 8 bit DMA write
+    sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_TX);
+    for (uint pin = cfg->base_pin; pin < cfg->base_pin + 8; pin++)
+    {
+      pio_gpio_init(port.pio, pin);
+    }
+    pio_sm_set_consecutive_pindirs(port.pio, port.sm, cfg->base_pin, 8, true);
+  }
+  if (cfg->strobe)
+  {
+    sm_config_set_sideset_pins(&c, cfg->base_pin + 8);
+    pio_gpio_init(port.pio, cfg->base_pin + 8);
+    pio_sm_set_consecutive_pindirs(port.pio, port.sm, cfg->base_pin + 8, 1, true);
+  }
+
+  // integer divider only, the byte period has no jitter
+  div = cfg->rate ? clk / (PORT_PIO_CYCLES * cfg->rate) : UINT16_MAX;
+  div = div < 1 ? 1 : (div > UINT16_MAX ? UINT16_MAX : div);
+  sm_config_set_clkdiv_int_frac(&c, (uint16_t)div, 0);
+
+  pio_sm_init(port.pio, port.sm, port.offset, &c);
+  port_pio_dma_start(cfg);
+  pio_sm_set_enabled(port.pio, port.sm, true);
+
+  return clk / (PORT_PIO_CYCLES * div);
+}
+
+void port_pio_stop(void)
+{
+  if (port.program == NULL)
+  {
+    return;
+  }
+  pio_sm_set_enabled(port.pio, port.sm, false);
+  port.count = port.repeat ? 0 : port.len - dma_channel_hw_addr(port.data_chan)->transfer_count;
+
+  // control channel aborted before and after the data channel, so the chain cannot restart it
+  dma_channel_abort(port.ctrl_chan);
+  dma_channel_abort(port.data_chan);
+  dma_channel_abort(port.ctrl_chan);
+
+  pio_sm_clear_fifos(port.pio, port.sm);
+  pio_sm_restart(port.pio, port.sm);
+  pio_remove_program(port.pio, port.program, port.offset);
+  port.program = NULL;
+
+  if (!port.capture)
+  {
+    for (uint pin = port.base_pin; pin < port.base_pin + 8; pin++)
+    {
+      gpio_set_function(pin, GPIO_FUNC_SIO);  // SIO output and direction registers apply again
+    }
+  }
+  if (port.strobe)
+  {
+    gpio_set_function(port.base_pin + 8, GPIO_FUNC_SIO);
+  }
+  port.repeat = false;
+}
+
+bool __not_in_flash_func(port_pio_busy)(void)
+{
+  if (port.program == NULL)
+  {
+    return false;
+  }
+  return port.repeat || dma_channel_hw_addr(port.data_chan)->transfer_count != 0;
+}
+
+uint32_t __not_in_flash_func(port_pio_count)(void)
+{
+  if (port.program == NULL)
+  {
+    return port.count;
+  }
+  if (port.repeat)
+  {
+    return 0;
+  }
+  return port.len - dma_channel_hw_addr(port.data_chan)->transfer_count;
+}
@@ -0,0 +1,73 @@
+/**
+ * @file    port_pio.h
+ * @author  Daniel Lockhead
+ * @date    2024
+ *
+ * @brief   PIO pattern output and capture on the 8 bit ports
+ *
+ * @copyright Copyright (c) 2024, D.Lockhead. All rights reserved.
+ *
+ * This software is licensed under the BSD 3-Clause License.
+ * See the LICENSE file for more details.
+ */
+
+#ifndef _PORT_PIO_H_
+#define _PORT_PIO_H_
+
+#include <pico/stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Pattern transfer configuration
+ */
+typedef struct
+{
+  uint base_pin;  /// first pin of the 8 bit port, strobe is base_pin + 8
+  bool capture;   /// true: sample the port into buf, false: output buf on the port
+  bool strobe;    /// pulse the strobe pin for each byte
+  bool repeat;    /// output only, restart the pattern at the end of buf, until stopped
+  uint32_t rate;  /// byte rate in Hz
+  uint8_t* buf;   /// pattern to output or capture buffer
+  uint32_t len;   /// number of bytes in buf
+} port_pio_config_t;
+
+/**
+ * @brief Claim the state machine and the DMA channels. Call once on core 0.
+ */
+void port_pio_init(void);
+
+/**
+ * @brief Start a pattern output or capture, a transfer in progress is stopped first.
+ *
+ * @param cfg  transfer configuration
+ * @return uint32_t byte rate used in Hz, clk_sys / 2 / integer divider
+ */
+uint32_t port_pio_start(const port_pio_config_t* cfg);
+
+/**
+ * @brief Stop the transfer, the port pins are returned to the CPU (SIO) with their previous direction and output.
+ */
+void port_pio_stop(void);
+
+/**
+ * @brief Check if a transfer is in progress.
+ *
+ * @return true DMA still transferring, always true for a repeated pattern
+ */
+bool port_pio_busy(void);
+
+/**
+ * @brief Number of bytes transferred by the last one-shot transfer.
+ *
+ * @return uint32_t bytes output or captured, 0 for a repeated pattern
+ */
+uint32_t port_pio_count(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // _PORT_PIO_H_
@@ -0,0 +1,97 @@
+/**
+ * @file    ringbuf.h
+ * @author  Daniel Lockhead
+ * @date    2024
+ *
+ * @brief   Single producer, single consumer ring buffer of variable length records
+ *
+ * @details The producer reserves space for a record, writes it in place and commits the length used.
+ * The consumer peeks the oldest record, uses it in place and releases it. A record is never split
+ * at the end of the buffer, so it is always contiguous and can be handed to any writer without copy.
+ *
+ * @copyright Copyright (c) 2024, D.Lockhead. All rights reserved.
+ *
+ * This software is licensed under the BSD 3-Clause License.
+ * See the LICENSE file for more details.
+ */
+
+#ifndef _RINGBUF_H_
+#define _RINGBUF_H_
+
+#include <pico/stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Ring buffer. head and tail are free running byte counters, the offset is obtained by masking.
+ */
+typedef struct
+{
+  uint8_t* buf;             /// Storage, 4 byte aligned.
+  uint32_t size;            /// Size of buf in bytes, power of 2.
+  volatile uint32_t head;   /// Write counter, updated by the producer only.
+  volatile uint32_t tail;   /// Read counter, updated by the consumer only.
+  uint32_t reserved_pos;    /// Counter of the record reserved, producer.
+  uint32_t peek_len;        /// Length of the record peeked, consumer.
+} ringbuf_t;
+
+/**
+ * @brief Initialise an empty ring buffer.
+ *
+ * @param rb    ring buffer
+ * @param buf   storage, 4 byte aligned
+ * @param size  size of buf in bytes, power of 2, at least 8
+ */
+void ringbuf_init(ringbuf_t* rb, uint8_t* buf, uint32_t size);
+
+/**
+ * @brief Reserve contiguous space for a record, to be written in place by the producer.
+ *
+ * @param rb   ring buffer
+ * @param len  maximum length of the record
+ * @return void* start of the record, NULL if there is no room
+ */
+void* ringbuf_reserve(ringbuf_t* rb, uint32_t len);
+
+/**
+ * @brief Publish the record reserved, visible by the consumer from now.
+ *
+ * @param rb   ring buffer
+ * @param len  length used, up to the length reserved
+ */
+void ringbuf_commit(ringbuf_t* rb, uint32_t len);
+
+/**
+ * @brief Get the oldest record, it stays in the buffer until released.
+ *
+ * @param rb   ring buffer
+ * @param len  length of the record
+ * @return const void* start of the record, NULL if empty
+ */
+const void* ringbuf_peek(ringbuf_t* rb, uint32_t* len);
+
+/**
+ * @brief Free the record returned by the last ringbuf_peek().
+ *
+ * @param rb   ring buffer
+ */
+void ringbuf_release(ringbuf_t* rb);
+
+/**
+ * @brief Number of bytes in use, record headers and padding included.
+ *
+ * @param rb   ring buffer
+ * @return uint32_t bytes in use
+ */
+static inline uint32_t ringbuf_used(const ringbuf_t* rb)
+{
+  return rb->head - rb->tail;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // _RINGBUF_H_
@@ -0,0 +1,99 @@
+/**
+ * @file    ringbuf.c
+ * @author  Daniel Lockhead
+ * @date    2024
+ *
+ * @brief   Single producer, single consumer ring buffer of variable length records
+ *
+ * @details Each record starts with a 4 byte header holding its length, and is padded to 4 bytes so the next
+ * header is aligned. When a record does not fit before the end of the buffer, a skip header is written at the
+ * end and the record starts at the beginning of the buffer.
+ *
+ * @copyright Copyright (c) 2024, D.Lockhead. All rights reserved.
+ *
+ * This software is licensed under the BSD 3-Clause License.
+ * See the LICENSE file for more details.
+ */
+
+#include <pico/stdlib.h>
+#include "hardware/sync.h"
+#include "ringbuf.h"
+
+#define RINGBUF_HEADER 4                        /**< Size of the record header. */
+#define RINGBUF_SKIP 0xFFFFFFFFu                /**< Header of the unused end of buffer. */
+#define RINGBUF_ALIGN(len) (((len) + 3u) & ~3u) /**< Record length padded to the header alignment. */
+
+void ringbuf_init(ringbuf_t* rb, uint8_t* buf, uint32_t size)
+{
+  rb->buf = buf;
+  rb->size = size;
+  rb->head = 0;
+  rb->tail = 0;
+  rb->reserved_pos = 0;
+  rb->peek_len = 0;
+}
+
+void* ringbuf_reserve(ringbuf_t* rb, uint32_t len)
+{
+  uint32_t need = RINGBUF_HEADER + RINGBUF_ALIGN(len);
+  uint32_t head = rb->head;
+  uint32_t avail = rb->size - (head - rb->tail);
+  uint32_t to_end = rb->size - (head & (rb->size - 1));
+
+  if (need > to_end)
+  {  // record is never split, the end of the buffer is skipped
+    if (avail < to_end + need)
+    {
+      return NULL;
+    }
+    head += to_end;
+  }
+  else if (avail < need)
+  {
+    return NULL;
+  }
+  rb->reserved_pos = head;
+  return &rb->buf[(head & (rb->size - 1)) + RINGBUF_HEADER];
+}
+
+void ringbuf_commit(ringbuf_t* rb, uint32_t len)
+{
+  uint32_t head = rb->head;
+
+  if (rb->reserved_pos != head)
+  {
+    *(uint32_t*)&rb->buf[head & (rb->size - 1)] = RINGBUF_SKIP;  // consumer restart at the beginning
+  }
+  *(uint32_t*)&rb->buf[rb->reserved_pos & (rb->size - 1)] = len;
+  __dmb();  // record content must be visible before the head update
+  rb->head = rb->reserved_pos + RINGBUF_HEADER + RINGBUF_ALIGN(len);
+}
+
+const void* ringbuf_peek(ringbuf_t* rb, uint32_t* len)
+{
+  uint32_t tail = rb->tail;
+  uint32_t pos;
+  uint32_t header;
+
+  if (tail == rb->head)
+  {
+    return NULL;
+  }
+  __dmb();  // record read after the head
+  pos = tail & (rb->size - 1);
+  header = *(const uint32_t*)&rb->buf[pos];
+  if (header == RINGBUF_SKIP)
+  {  // always followed by a record at the beginning
+    rb->tail = tail + rb->size - pos;
+    pos = 0;
+    header = *(const uint32_t*)&rb->buf[0];
+  }
+  rb->peek_len = header;
+  *len = header;
+  return &rb->buf[pos + RINGBUF_HEADER];
+}
+
+void ringbuf_release(ringbuf_t* rb)
+{
+  rb->tail = rb->tail + RINGBUF_HEADER + RINGBUF_ALIGN(rb->peek_len);
+}
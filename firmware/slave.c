@@ -18,19 +18,40 @@
 #include <i2c_fifo.h>
 #include <i2c_slave.h>
 #include <pico/stdlib.h>
+#include <ringbuf.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include "hardware/clocks.h"
+#include "hardware/irq.h"
+#include "hardware/structs/systick.h"
+#include "hardware/sync.h"
 #include "hardware/watchdog.h"
+#include "pico/flash.h"
+#include "pico/multicore.h"
+#include "pico/stdio_usb.h"
+#include "flash_config.h"
+#include "port_pio.h"
 #include "userconfig.h"
 
+#ifdef USE_MASTER_LOOPBACK
+#include "bench.h"
+#endif
+
+#if I2C_SLAVE1_ADDRESS != 0 && !defined(USE_MASTER_LOOPBACK)
+#define USE_I2C_SLAVE1  // second slave on i2c1, used as loopback master by the slave_bench target
+#endif
+
 static const uint I2C_OFFSET_ADDRESS = 0x20;  // ofsset to add to the physical address read
-static const uint PICO_PORT_ADDRESS = 0x21;   // Pico address where port is used
-static const uint REG_STATUS = 100;           // Register used to report Status
 
-static const uint I2C_BAUDRATE = 100000;       // 100 kHz
+static const uint I2C_BAUDRATE = I2C_SLAVE_BAUDRATE;  // speed at boot, defined by cmake
+static const uint I2C_SPEED_MODES[] = {100000, 400000, 1000000};  // Standard, Fast-mode, Fast-mode Plus
+static const uint I2C_RX_THRESHOLD = 8;  // Rx FIFO bytes per receive interrupt, rest is read on Stop
+static const uint I2C_TX_THRESHOLD = 4;  // Tx FIFO refilled at this level during a multi-byte read
 static const uint I2C_SLAVE_ADDRESS_IO0 = 26;  // Bit 0 of I2C Address
 static const uint I2C_SLAVE_ADDRESS_IO1 = 27;  // Bit 1 of I2C Address
+static const uint ADDRESS_SETTLE_US = 10;      // Address pins settling time after pull-up enabled
 
 // For this example, we run both the master and slave from the same board.
 // You'll need to wire pin GP4 to GP6 (SDA), and pin GP5 to GP7 (SCL).
@@ -43,11 +64,7 @@ static const uint32_t PORT1_MASK = 0b111111110000000000;
 static const uint PORT1_OFFSET = 10;  // shift to do for match mask
 
 // static const uint32_t GPIO_SET_DIR_MASK =  0b0001000001111111111111111111111;  // GPIO MASK
-static const uint32_t GPIO_SET_DIR_MASK = 0b0011110001111111111111111111111;    // GPIO MASK
-static const uint32_t GPIO_SLV1_DIR_MASK = 0b00010000000000000000000000000000;  // IO Slave
-static const uint32_t GPIO_SLV1_OUT_MASK = 0x00ul;                              // All output to 0
-static const uint32_t GPIO_SLV2_DIR_MASK = 0b0011110001111111111111111111111;   // Relay Slave, all
-static const uint32_t GPIO_SLV2_OUT_MASK = 0x00ul;                              // All output to 0
+static const uint32_t GPIO_SET_DIR_MASK = 0b0011110001111111111111111111111;    // GPIO MASK, default of each board in BOARD_PERSONALITIES
 
 static const uint32_t GPIO_BANK0_MASK = 0xfful;  // Bank 0
 static const uint32_t GPIO_BANK1_MASK = 0b00000000000000111111110000000000;
@@ -56,92 +73,151 @@ static const uint32_t GPIO_BANK1_MASK = 0b00000000000000111111110000000000;
 //#define PICO_DEFAULT_UART_TX_PIN 8  // if Serial enabled
 //#define PICO_DEFAULT_UART_RX_PIN 9
 
-/*
-Portable array-based cyclic FIFO queue.
-Copy from Internet
-*/
+#define MESSAGE_SIZE 64     /**< Maximum length of a message. */
+#define LOG_QUEUE_SIZE 512  /**< Size of the message queue in bytes, power of 2, only used for boot and configuration messages. */
 
 /**
- * @brief Queue implementation for MESSAGE structures.
+ * @brief Bus and load statistics, read by master with command 106 and cleared with command 107.
+ *        32 bit counters, incremented without lock, wrap around.
  */
-#define MESSAGE_SIZE 64 /**< Size of each message. */
-#define QUEUE_SIZE 64   /**< Size of the queue (set high for development). */
+  static struct
+  {
+    uint32_t start;            /// Time of the last clear, in us.
+    uint32_t transactions;     /// Transfers ended by Stop or Restart.
+    uint32_t rx_bytes;         /// Bytes received from master, command and data.
+    uint32_t tx_bytes;         /// Bytes sent to master.
+    uint32_t tx_aborts;        /// Transmit aborted, Tx FIFO flushed.
+    uint32_t rejected;         /// Commands rejected with status command flag.
+    uint32_t queue_overflows;  /// Messages dropped, message queue full.
+    uint32_t queue_peak;       /// Maximum use of the message queue, in bytes.
+    uint32_t events_dropped;   /// Events dropped, event ring full.
+    uint32_t events_peak;      /// Maximum number of events in ring.
+  } stats;
 
 /**
- * @brief Structure representing a message.
+ * @brief Message queue, variable length text records written and sent to USB in place.
  */
-typedef struct
-{
-  char data[MESSAGE_SIZE]; /**< Data contained in the message. */
-} MESSAGE;
-
-/**
-* @brief Global queue structure.
-*/
-  struct
-  {
-    MESSAGE messages[QUEUE_SIZE];  /// Array of messages.
-    int begin;                     /// Index of the first message.
-    int end;                       /// Index of the last message.
-    int current_load;              /// Current number of messages in the queue.
-  } queue;
+  static ringbuf_t log_queue;
+  static uint8_t __attribute__((aligned(4))) log_queue_buf[LOG_QUEUE_SIZE];
 
   /**
-   * @brief Enqueue a message into the queue.
+   * @brief Format a message directly into the message queue, printed on serial port by core 1.
    *
-   * @param message Pointer to the message to be enqueued.
-   * @return true if the message was successfully enqueued, false if the queue is full.
+   * @param fmt printf format
+   * @param ... arguments
+   * @return true if the message was queued, false if the queue is full.
    */
-  bool enque(MESSAGE* message)
+  static bool log_message(const char* fmt, ...)
   {
-    if (queue.current_load < QUEUE_SIZE)
+    va_list args;
+    char* msg = ringbuf_reserve(&log_queue, MESSAGE_SIZE);
+    int len;
+
+    if (msg == NULL)
     {
-      if (queue.end == QUEUE_SIZE)
-      {
-        queue.end = 0;
-      }
-      queue.messages[queue.end] = *message;  /// Add the message to the queue.
-      queue.end++;
-      queue.current_load++;
-      return true;
+      stats.queue_overflows++;
+      return false;
     }
-    else
+    va_start(args, fmt);
+    len = vsnprintf(msg, MESSAGE_SIZE, fmt, args);
+    va_end(args);
+    ringbuf_commit(&log_queue, len < 0 ? 0 : (len >= MESSAGE_SIZE ? MESSAGE_SIZE - 1 : (uint32_t)len));
+
+    if (ringbuf_used(&log_queue) > stats.queue_peak)
     {
-      return false;
+      stats.queue_peak = ringbuf_used(&log_queue);
     }
+    __sev();  // wake up the core 1 housekeeping loop
+    return true;
   }
 
   /**
-   * @brief Initialize the queue.
+   * @brief Event flags stored with each log event.
+   */
+  #define EVT_WRITE 0x01    /**< Write command executed. */
+  #define EVT_READ 0x02     /**< Read command executed, result contains value returned to master. */
+  #define EVT_INVALID 0x04  /**< Command not valid for this I2C address. */
+  #define EVT_BAD_ARG 0x08  /**< Data byte not valid for the command. */
+  #define EVT_BAD_CMD 0x10  /**< Command byte out of range or not supported. */
+  #define EVT_BAD_PEC 0x20  /**< PEC of the write not valid, arg is the PEC received and result the PEC expected. */
+
+  #define EVENT_RING_SIZE 64 /**< Number of events in the ring, must be a power of 2. */
+
+  /**
+   * @brief Compact binary log record pushed from the I2C ISR. The text is formatted on the main loop.
    */
-  void init_queue()
+  typedef struct
   {
-    queue.begin = 0;                                                   /// Initialize the beginning index.
-    queue.end = 0;                                                     /// Initialize the end index.
-    queue.current_load = 0;                                            /// Initialize the current load.
-    memset(&queue.messages[0], 0, QUEUE_SIZE * sizeof(MESSAGE_SIZE));  /// Clear the queue.
-  }
+    uint32_t time;   /// Timestamp in us (lower 32 bits of hardware timer).
+    uint8_t cmd;     /// Command number.
+    uint8_t arg;     /// Data byte written by master (gpio, bank, mask...).
+    uint8_t result;  /// Value returned to master on read command.
+    uint8_t flags;   /// Event flags (EVT_xxx).
+  } EVENT;
+
+  /**
+   * @brief Single producer (I2C ISR), single consumer (main loop) lock-free ring of events.
+   *        head and tail are free running counters, index is obtained by masking.
+   */
+  static struct
+  {
+    EVENT events[EVENT_RING_SIZE];  /// Array of events.
+    volatile uint32_t head;         /// Write counter, updated by ISR only.
+    volatile uint32_t tail;         /// Read counter, updated by main loop only.
+  } event_ring;
 
   /**
-   * @brief Dequeue a message from the queue.
+   * @brief Push an event into the ring, called from the I2C ISR.
    *
-   * @param message Pointer to the message to be dequeued.
-   * @return true if the message was successfully dequeued, false if the queue is empty.
+   * @param cmd     command number
+   * @param arg     data byte received
+   * @param result  value returned to master
+   * @param flags   event flags
+   * @return true if the event was recorded, false if the ring is full.
    */
-  bool deque(MESSAGE* message)
+  static inline bool log_event(uint8_t cmd, uint8_t arg, uint8_t result, uint8_t flags)
   {
-    if (queue.current_load > 0)
+    uint32_t head = event_ring.head;
+    uint32_t depth = head - event_ring.tail;
+    if (depth >= EVENT_RING_SIZE)
     {
-      *message = queue.messages[queue.begin];                    /// Retrieve the message from the queue.
-      memset(&queue.messages[queue.begin], 0, sizeof(MESSAGE));  /// Clear the dequeued message.
-      queue.begin = (queue.begin + 1) % QUEUE_SIZE;              /// Update the beginning index.
-      queue.current_load--;
-      return true;
+      stats.events_dropped++;
+      return false;  // ring full, event dropped
     }
-    else
+    if (depth + 1 > stats.events_peak)
+    {
+      stats.events_peak = depth + 1;
+    }
+    EVENT* evt = &event_ring.events[head & (EVENT_RING_SIZE - 1)];
+    evt->time = time_us_32();
+    evt->cmd = cmd;
+    evt->arg = arg;
+    evt->result = result;
+    evt->flags = flags;
+    __dmb();  // event content must be visible before the head update
+    event_ring.head = head + 1;
+    __sev();  // wake up the core 1 housekeeping loop
+    return true;
+  }
+
+  /**
+   * @brief Pop the oldest event from the ring, called from the main loop.
+   *
+   * @param evt Pointer to the event to fill.
+   * @return true if an event was available, false if the ring is empty.
+   */
+  static bool pop_event(EVENT* evt)
+  {
+    uint32_t tail = event_ring.tail;
+    if (tail == event_ring.head)
     {
       return false;
     }
+    __dmb();  // read event content after the head value
+    *evt = event_ring.events[tail & (EVENT_RING_SIZE - 1)];
+    __dmb();
+    event_ring.tail = tail + 1;
+    return true;
   }
 
   /**
@@ -157,561 +233,3097 @@ typedef struct
       uint8_t cmd : 1;      /// Command error flag.
       uint8_t error : 1;    /// General error flag.
       uint8_t watch : 1;    /// Watchdog error flag.
-      uint8_t sparesA : 1;  /// Spare flag A.
-      uint8_t sparesB : 1;  /// Spare flag B.
+      uint8_t change : 1;   /// Input change flag, cleared by command 58.
+      uint8_t ready : 1;    /// Boot completed flag, all commands available.
       uint8_t sparesC : 1;  /// Spare flag C.
       uint8_t sparesD : 1;  /// Spare flag D.
     };
   } status;
 
+  #define TX_BUF_SIZE 64     /**< Maximum size of a multi-byte read. */
+  #define PEC_BUF_SIZE 32    /**< Maximum size of a write in PEC mode, PEC byte included. */
+  #define TX_DMA_MIN 16      /**< Multi-byte read longer than the Tx FIFO are sent by DMA. */
+  #define CMD_TABLE_SIZE 128 /**< Number of command in table, one entry per command byte value. */
+
+  /**
+   * @brief Error code of the last command rejected, read with command 101.
+   */
+  typedef enum
+  {
+    ERR_NONE = 0,     /// No error.
+    ERR_CMD = 1,      /// Command byte out of range or not supported, rest of transfer ignored.
+    ERR_ADDRESS = 2,  /// Command not valid for this I2C address.
+    ERR_DATA = 3,     /// Data byte out of range for the command (gpio > 29, ...).
+    ERR_PEC = 4,      /// PEC of the write not valid, whole transfer ignored.
+  } error_code_t;
+
   /**
    * @brief The slave implements a 128 byte memory. The memory address use the command byte value as memory pointer,
    *        The 8 bit data is written starting at command value
    *
    */
-  static struct
+  typedef struct
   {
-    uint8_t reg[128];          // contains data following command byte
-    uint8_t reg_address;       // contains command number
-    uint8_t reg_status;        // contains status of command
-    bool reg_address_written;  // Flag for command byte received
+    uint8_t reg[CMD_TABLE_SIZE];  // contains data following command byte
+    uint8_t reg_address;          // contains command number
+    bool reg_address_written;     // Flag for command byte received
+    uint8_t data_count;           // number of data bytes received since the command byte
+    bool cmd_rejected;            // command byte not supported, data bytes are discarded
+    bool broadcast;               // write addressed with the general call address
+    uint8_t error;                // code of the last command rejected (error_code_t)
+    uint8_t tx_buf[TX_BUF_SIZE + 1];  // data of a multi-byte read, and its PEC
+    uint8_t tx_len;               // number of bytes in tx_buf, 0 for single byte read
+    uint8_t tx_pos;               // next byte of tx_buf to send
     uint8_t i2c_add;
-  } context;
+    uint8_t groups;               // command groups of the board personality (CMD_GROUP_xxx)
+    uint8_t speed_mode;           // index in I2C_SPEED_MODES of the speed in use
+    uint8_t speed_request;        // index in I2C_SPEED_MODES requested by master
+    volatile bool speed_pending;  // speed change requested by master, applied when bus is idle
+    i2c_inst_t* i2c;              // controller of this slave
+    uint8_t sda_pin;              // SDA pin of the controller
+    uint8_t scl_pin;              // SCL pin of the controller
+    bool pec;                     // PEC mode set by command 103
+    bool pec_frame;               // PEC mode of the write in progress, latched on its first byte
+    uint8_t pec_len;              // number of bytes of the write in progress in PEC mode
+    uint8_t pec_buf[PEC_BUF_SIZE];  // write in progress in PEC mode, executed on Stop when the PEC is valid
+  } slave_context_t;
+
+  static slave_context_t context;   // i2c0, address from the strap pins
+  static slave_context_t context1;  // i2c1, second slave address, see I2C_SLAVE1_ADDRESS
 
   /**
-   * @brief Our handler is called from the I2C ISR, so it must complete quickly. Blocking calls
-   * printing to stdio may interfere with interrupt handling.
-   *
-   * @param i2c i2c instance used
-   * @param event interrupt from receive or transmit
+   * @brief Shadow output and direction registers. The master stages changes in the shadow registers,
+   *        then all outputs and directions are applied in one operation with the commit command.
    */
-  static void i2c_slave_handler(i2c_inst_t* i2c, i2c_slave_event_t event)
+  static struct
   {
-    MESSAGE rec;
-    uint8_t cmd;  /// keep command value
-    bool tvalue;
-    uint8_t svalue;
-    volatile uint32_t maskvalue, lvalue;
+    uint32_t out;  /// Output value staged, applied on the shadow_mask() lines.
+    uint32_t dir;  /// Direction staged, applied on the shadow_mask() lines, 1 = Out.
+  } shadow;
 
-    switch (event)
-    {
-      case I2C_SLAVE_RECEIVE:              /// master has written some data
-        if (!context.reg_address_written)  /// if command data already received
-        {
-          // writes always start with the memory address
-          context.reg_address = i2c_read_byte(i2c);  // read Command byte
-          context.reg_address_written = true;
-          // sprintf(&rec.data[0],"On i2c  cmd");
-          // enque(&rec);
-        }
-        else                                                      /// read data byte
-        {                                                         // WRITE COMMAND
-          context.reg[context.reg_address] = i2c_read_byte(i2c);  // read Byte
-                                                                  // sprintf(&rec.data[0],"On i2c  data");
-                                                                  // enque(&rec);
-
-          cmd = context.reg_address;
-
-          /// Based on Command number, an action is executed
-
-          switch (cmd)
-          {  /// Command byte
-
-            case 10:  // Clear Gpio
-              gpio_put(context.reg[context.reg_address], 0);
-              sprintf(&rec.data[0], "Cmd %02d, Clear Gpio: %02d ", cmd, context.reg[context.reg_address]);
-              enque(&rec);
-              break;
-
-            case 11:  // Set Gpio
-              gpio_put(context.reg[context.reg_address], 1);
-              sprintf(&rec.data[0], "Cmd %02d, Set Gpio: %02d ", cmd, context.reg[context.reg_address]);
-              enque(&rec);
-              break;
-
-            case 12:  // Clear Bank
-              if (context.reg[context.reg_address] < 10)
-              {                                            // bank 0
-                gpio_put_masked(GPIO_BANK0_MASK, 0x00ul);  // Set Output
-              }
-              else
-              {
-                gpio_put_masked(GPIO_BANK1_MASK, 0x00ul);  // Set Output
-              }
-              sprintf(&rec.data[0], "Cmd %02d, Clear Bank Gpio: %02d ", cmd, context.reg[context.reg_address]);
-              enque(&rec);
-              break;
-
-            case 20:                                              // Set Gpio Direction to Output
-              gpio_set_dir(context.reg[context.reg_address], 1);  // turn OFF Led
-              sprintf(&rec.data[0], "Cmd %02d, Set Dir Out Gpio: %02d ", cmd, context.reg[context.reg_address]);
-              enque(&rec);
-              break;
-
-            case 21:                                              // Set Gpio Direction to Input
-              gpio_set_dir(context.reg[context.reg_address], 0);  // turn OFF Led
-              sprintf(&rec.data[0], "Cmd %02d, Set dir In Gpio: %02d ", cmd, context.reg[context.reg_address]);
-              enque(&rec);
-              break;
-
-            case 30:                                                                               // Set GPIO strength = 2mA
-              gpio_set_drive_strength(context.reg[context.reg_address], GPIO_DRIVE_STRENGTH_2MA);  // set Value
-              sprintf(&rec.data[0], "Cmd %02d, 2mA Gpio: %02d ", cmd, context.reg[context.reg_address]);
-              enque(&rec);
-              break;
-
-            case 31:                                                                               // Set GPIO strength = 4mA
-              gpio_set_drive_strength(context.reg[context.reg_address], GPIO_DRIVE_STRENGTH_4MA);  // set Value
-              sprintf(&rec.data[0], "Cmd %02d, 4mA Gpio: %02d ", cmd, context.reg[context.reg_address]);
-              enque(&rec);
-              break;
-
-            case 32:                                                                               // Set GPIO strength = 8mA
-              gpio_set_drive_strength(context.reg[context.reg_address], GPIO_DRIVE_STRENGTH_8MA);  // set Value
-              sprintf(&rec.data[0], "Cmd %02d, 8mA Gpio: %02d ", cmd, context.reg[context.reg_address]);
-              enque(&rec);
-              break;
-
-            case 33:                                                                                // Set GPIO strength = 12mA
-              gpio_set_drive_strength(context.reg[context.reg_address], GPIO_DRIVE_STRENGTH_12MA);  // set Value
-              sprintf(&rec.data[0], "Cmd %02d, 12mA Gpio: %02d ", cmd, context.reg[context.reg_address]);
-              enque(&rec);
-              break;
-
-            case 41:                                           // Set pull-up
-              gpio_pull_up(context.reg[context.reg_address]);  // turn ON pull-up
-              sprintf(&rec.data[0], "Cmd %02d, Pull-up Gpio: %02d,  ", cmd, context.reg[context.reg_address]);
-              enque(&rec);
-              break;
-
-            case 50:                                                 // Clear pull-up and pull-down
-              gpio_disable_pulls(context.reg[context.reg_address]);  // turn ON pull-up
-              sprintf(&rec.data[0], "Cmd %02d, Clear pull-up, pull-down Gpio: %02d,  ", cmd, context.reg[context.reg_address]);
-              enque(&rec);
-              break;
-
-            case 51:                                             // Set pull-down
-              gpio_pull_down(context.reg[context.reg_address]);  // turn ON pull-down
-              sprintf(&rec.data[0], "Cmd %02d, Pull-down Gpio: %02d,  ", cmd, context.reg[context.reg_address]);
-              enque(&rec);
-              break;
-
-            case 60:  // Set PAD state, Nothing to do other than save on register
-              sprintf(&rec.data[0], "Cmd %02d, Pad State: %01d ", cmd, context.reg[context.reg_address]);
-              enque(&rec);
-              break;
-
-            case 61:  // Set GPx to PAD state
-              maskvalue = 0xfful;
-              hw_write_masked(&pads_bank0_hw->io[context.reg[context.reg_address]], context.reg[cmd - 1], maskvalue);  // Set Pad state
-              sprintf(&rec.data[0], "Cmd %02d, Set Pad State to Gpio: %02d ,State: 0x%01x ", cmd, context.reg[context.reg_address],
-                      context.reg[cmd - 1]);
-              enque(&rec);
-              break;
-
-            case 80:  // Set Direction  Port 0 using 8 bit mask
-              if (context.i2c_add == PICO_PORT_ADDRESS)
-              {  // if command valid following i2c_address
-                maskvalue = context.reg[context.reg_address];
-                gpio_set_dir_masked(PORT0_MASK, maskvalue);  // Set Direction
-                sprintf(&rec.data[0], "Cmd %02d, Port0, dir: 0x%02lx,  ", cmd, maskvalue);
-              }
-              else
-              {
-                sprintf(&rec.data[0], "Cmd %02d, Not Valid for I2C Pico: 0x%02x,  ", cmd, context.i2c_add);
-                status.cmd = 1;  // raise error flag
-              }
-              enque(&rec);
-              break;
-
-            case 81:  // Set Output on 8 bit port 0
-              if (context.i2c_add == PICO_PORT_ADDRESS)
-              {  // if command valid following i2c_address
-                maskvalue = context.reg[context.reg_address];
-                gpio_put_masked(PORT0_MASK, maskvalue);  // Set Direction
-                sprintf(&rec.data[0], "Cmd %02d, Port0, 8 bit Out: 0x%02x,  ", cmd, context.reg[context.reg_address]);
-              }
-              else
-              {
-                sprintf(&rec.data[0], "Cmd %02d, Not Valid for I2C Pico: 0x%02x,  ", cmd, context.i2c_add);
-                status.cmd = 1;  // raise error flag
-              }
-              enque(&rec);
-              break;
-
-            case 90:  // Set Direction of port 1 using 8 bit mask
-              if (context.i2c_add == PICO_PORT_ADDRESS)
-              {  // if command valid following i2c_address
-                maskvalue = context.reg[context.reg_address] << PORT1_OFFSET;
-                gpio_set_dir_masked(PORT1_MASK, maskvalue);  // Set Direction
-                sprintf(&rec.data[0], "Cmd %02d, Port1, dir: 0x%02lx,  ", cmd, maskvalue);
-              }
-              else
-              {
-                sprintf(&rec.data[0], "Cmd %02d, Not Valid for I2C Pico: 0x%02x,  ", cmd, context.i2c_add);
-                status.cmd = 1;  // raise error flag
-              }
-              enque(&rec);
-              break;
-
-            case 91:  // Set Output on 8 bit port 1
-              if (context.i2c_add == PICO_PORT_ADDRESS)
-              {  // if command valid following i2c_address
-                maskvalue = context.reg[context.reg_address] << PORT1_OFFSET;
-                gpio_put_masked(PORT1_MASK, maskvalue);  // Set Output
-                sprintf(&rec.data[0], "Cmd %02d, Port1, 8 bit Out: 0x%02x,  ", cmd, context.reg[context.reg_address]);
-              }
-              else
-              {
-                sprintf(&rec.data[0], "Cmd %02d, Not Valid for I2C Pico: 0x%02x,  ", cmd, context.i2c_add);
-              }
-              enque(&rec);
-              break;
-          }
-        }
-        break;
-
-      case I2C_SLAVE_REQUEST:  // master is requesting data
-                               // load from register
-        cmd = context.reg_address;
-
-        // For command requesting a Get Value, The register is updated before return the content
-        // For readback of Set value, we just return the contents of register
+  /**
+   * @brief Input change notification. The edge interrupts of the enabled pins latch the changed pins
+   *        and the time of the last change, cleared when read by master with command 58.
+   */
+  static struct
+  {
+    volatile uint32_t changed;  /// Pins changed since last read, 1 = changed.
+    volatile uint32_t time;     /// Time of the last change, in us (time_us_32).
+    volatile uint32_t count;    /// Number of edges since last read.
+    uint32_t enabled;           /// Pins with edge interrupt enabled.
+  } edge;
+
+  #define PATTERN_SIZE 1024  /**< Size of the PIO pattern and capture buffer. */
+  #define PATTERN_PORT1 0x01   /**< Command 87 mode: Port 1, else Port 0. */
+  #define PATTERN_CAPTURE 0x02 /**< Command 87 mode: sample the port, else output the pattern. */
+  #define PATTERN_STROBE 0x04  /**< Command 87 mode: strobe pulse on the pin following the port (GP8 or GP18). */
+  #define PATTERN_REPEAT 0x08  /**< Command 87 mode: output the pattern in loop until stopped. */
+  #define PATTERN_STOP 0xFF    /**< Stop requested with command 88. */
 
-        switch (cmd)
-        {  // Command byte yo et register
+  /**
+   * @brief PIO parallel port. The master load the pattern with command 82, then start the output or the capture
+   *        with command 87. Start and stop are applied by the core 0 main loop, outside of the I2C interrupt.
+   */
+  static struct
+  {
+    uint8_t buf[PATTERN_SIZE];  /// Pattern to output, or data captured.
+    uint16_t len;               /// Number of pattern bytes loaded with command 82.
+    uint16_t read_pos;          /// Next byte read back by master with command 82.
+    uint8_t mode;               /// Mode requested with command 87, PATTERN_STOP with command 88.
+    volatile bool pending;      /// Start or stop requested, applied by core 0 main loop.
+    uint32_t rate;              /// Byte rate in use, in Hz.
+    uint16_t khz;               /// Byte rate requested with command 83 and 84, in kHz.
+  } pattern;
+
+  #define SEQ_SIZE 256         /**< Size of the sequence program. */
+  #define SEQ_DELAY_US 0x80    /**< Sequence op: delay, 2 bytes in us LSB first. */
+  #define SEQ_DELAY_MS 0x81    /**< Sequence op: delay, 2 bytes in ms LSB first. */
+  #define SEQ_WAIT_HIGH 0x82   /**< Sequence op: wait input high, gpio and 2 bytes timeout in ms LSB first. */
+  #define SEQ_WAIT_LOW 0x83    /**< Sequence op: wait input low, gpio and 2 bytes timeout in ms LSB first. */
+  #define SEQ_END 0x84         /**< Sequence op: end of program. */
+  #define SEQ_BUSY_WAIT_US 20  /**< Shorter delays are busy waits, longer ones use an alarm. */
+  #define SEQ_POLL_US 10       /**< Input polling period of the wait ops. */
+
+  #define SEQ_RUN 1   /**< Command 04 data: run the sequence. */
+  #define SEQ_ABORT 2 /**< Command 04 data: abort the sequence running. */
 
-          case 01:  // get Major Version
-            context.reg[context.reg_address] = IO_SLAVE_VERSION_MAJOR;
-            sprintf(&rec.data[0], "Cmd %02d, MAJ Version: %02d ", cmd, context.reg[context.reg_address]);
-            enque(&rec);
-            break;
+  /**
+   * @brief State of the sequence, read with command 05.
+   */
+  typedef enum
+  {
+    SEQ_IDLE = 0,     /// No sequence run since the program load.
+    SEQ_RUNNING = 1,  /// Sequence in progress on core 1.
+    SEQ_DONE = 2,     /// End of program reached.
+    SEQ_ERROR = 3,    /// Invalid op, command or data at pc, sequence not started or stopped.
+    SEQ_TIMEOUT = 4,  /// Input wait timeout at pc.
+    SEQ_ABORTED = 5,  /// Aborted by master.
+  } seq_state_t;
 
-          case 02:  // get Minor Version
-            context.reg[context.reg_address] = IO_SLAVE_VERSION_MINOR;
-            sprintf(&rec.data[0], "Cmd %02d, MIN Version: %02d ", cmd, context.reg[context.reg_address]);
-            enque(&rec);
-            break;
+  /**
+   * @brief Sequence engine. The master loads a program of commands (2 bytes: command, data) and timing ops
+   *        with command 03, then run it with command 04. The program is executed on core 1 by alarm callbacks.
+   */
+  static struct
+  {
+    uint8_t prog[SEQ_SIZE];      /// Program loaded by master.
+    uint16_t len;                /// Number of bytes in program.
+    volatile uint16_t pc;        /// Next op executed.
+    volatile uint8_t state;      /// seq_state_t.
+    uint32_t start;              /// Start time, in us.
+    volatile uint32_t duration;  /// Execution time of the last run, in us.
+    uint64_t deadline;           /// Timeout of the input wait in progress, 0 if none.
+    alarm_id_t alarm;            /// Alarm of the next step, 0 if none. Changed with interrupts disabled on core 1.
+    uint32_t run;                /// Run number given to the alarm, an alarm of a previous run is ignored.
+  } seq;
+
+  #define PULSE_SLOTS 8          /**< Number of pulses running at the same time. */
+  #define PULSE_MIN_US 5         /**< Shortest time between two edges, alarm latency is about 2 us. */
+  #define PULSE_START 0x100      /**< Core 1 FIFO request: start the pulse of the slot in the low byte. */
+  #define PULSE_STOP 0x200       /**< Core 1 FIFO request: stop the pulse of the slot in the low byte. */
 
-          case 13:                    // read Bank status
-            lvalue = gpio_get_all();  // Read All GPIO
-            if (context.reg[context.reg_address] < 10)
-            {                              // bank 0
-              svalue = (uint8_t)(lvalue);  // read lower bank
-            }
-            else
-            {
-              svalue = (uint8_t)(lvalue >> 10);  // read high bank
-            }
-            sprintf(&rec.data[0], "Cmd %02d, Bank: %02d, read: 0x%01x ", cmd, context.reg[context.reg_address], svalue);
-            enque(&rec);
-            context.reg[context.reg_address] = svalue;
-            break;
+  /**
+   * @brief Pulse in progress. The output is inverted at each edge, an even number of edges restores the level.
+   */
+  typedef struct
+  {
+    uint8_t pin;               /// Gpio pulsed.
+    volatile uint16_t edges;   /// Edges left, set by core 0 to start, cleared by core 1 at the end. Slot free if 0.
+    uint32_t half;             /// Time between two edges, in us.
+    alarm_id_t alarm;          /// Alarm of the next edge, 0 if none.
+  } pulse_t;
 
-          case 15:                                                // read True value of Gpio
-            tvalue = gpio_get(context.reg[context.reg_address]);  // Read true Value
-            sprintf(&rec.data[0], "Cmd %02d, read True Gpio: %02d ,State: %01d ", cmd, context.reg[context.reg_address], tvalue);
-            enque(&rec);
-            context.reg[context.reg_address] = tvalue;
-            break;
+  /**
+   * @brief Timed pulses and pulse trains started with command 27 and 28. The edges are made by alarm callbacks
+   *        on core 1, so the timing does not depend on I2C traffic and several pins can pulse at the same time.
+   */
+  static pulse_t pulses[PULSE_SLOTS];
 
-          case 25:                                                    // get GPIO Direction
-            tvalue = gpio_get_dir(context.reg[context.reg_address]);  // Read Direction Value
-            sprintf(&rec.data[0], "Cmd %02d, Red Dir Gpio: %02d ,State: %01d ", cmd, context.reg[context.reg_address], tvalue);
-            enque(&rec);
-            context.reg[context.reg_address] = tvalue;
-            break;
+  #define DEBOUNCE_SAMPLE_US 1000 /**< Input sampling period of the debounce filter. */
+  #define DEBOUNCE_START 0x400    /**< Core 1 FIFO request: start the input sampling. */
 
-          case 35:                                                               // get GPIO strength
-            svalue = gpio_get_drive_strength(context.reg[context.reg_address]);  // Read strength Value
-            sprintf(&rec.data[0], "Cmd %02d, Read strenght Gpio: %02d ,State: %01d ", cmd, context.reg[context.reg_address], svalue);
-            enque(&rec);
-            context.reg[context.reg_address] = svalue;
-            break;
+  /**
+   * @brief Debounce filter of the inputs, read with commands 18, 19, 86 and 96. All GPIO are sampled every ms by
+   *        an alarm on core 1. Each pin has an integrator counting up when high and down when low, from 0 to the
+   *        window set by command 17: the stable value changes when the integrator reaches 0 or the window.
+   */
+  static struct
+  {
+    volatile uint8_t window;           /// Debounce time in ms (samples), 0: filter off, raw value returned.
+    volatile uint32_t stable;          /// Filtered value of GP0 to GP29.
+    uint8_t count[NUM_BANK0_GPIOS];    /// Integrator of each pin, core 1.
+    bool running;                      /// Sampling alarm in progress, core 1.
+  } debounce;
 
-          case 45:                                                         // get pull-up
-            tvalue = gpio_is_pulled_up(context.reg[context.reg_address]);  // Read true Value
-            sprintf(&rec.data[0], "Cmd %02d, read pull-up Gpio: %02d ,State: %01d ", cmd, context.reg[context.reg_address], tvalue);
-            enque(&rec);
-            context.reg[context.reg_address] = tvalue;
-            break;
+  #define CAPTURE_SIZE 2048      /**< Number of samples in the capture buffer, power of 2. */
+  #define CAPTURE_MIN_US 10      /**< Shortest sampling period, the alarm callback takes about 2 us. */
+  #define CAPTURE_START 0x800    /**< Core 1 FIFO request: start the capture. */
 
-          case 55:                                                           // get pull-down
-            tvalue = gpio_is_pulled_down(context.reg[context.reg_address]);  // Read true Value
-            sprintf(&rec.data[0], "Cmd %02d, Read pull-down Gpio: %02d ,State: %01d ", cmd, context.reg[context.reg_address], tvalue);
-            enque(&rec);
-            context.reg[context.reg_address] = tvalue;
-            break;
+  #define CAPTURE_STOP 0     /**< Command 97 data: stop the capture. */
+  #define CAPTURE_RUN 1      /**< Command 97 data: start, sample until stopped. */
+  #define CAPTURE_RISING 2   /**< Command 97 data: start, stop half a buffer after a rising edge of the trigger pin. */
+  #define CAPTURE_FALLING 3  /**< Command 97 data: start, stop half a buffer after a falling edge of the trigger pin. */
 
-          case 65:                                                                // get PAD state
-            svalue = pads_bank0_hw->io[context.reg[context.reg_address]] & 0xff;  // Read gpio PAD Value
-            sprintf(&rec.data[0], "Cmd %02d, Gpio: %02d ,Read PAD State: 0x%01x ", cmd, context.reg[context.reg_address], svalue);
-            enque(&rec);
-            context.reg[context.reg_address] = svalue;
-            break;
+  /**
+   * @brief State of the port capture, read with command 99.
+   */
+  typedef enum
+  {
+    CAPTURE_IDLE = 0,       /// No capture since boot.
+    CAPTURE_RUNNING = 1,    /// Sampling, waiting for the trigger edge if one is selected.
+    CAPTURE_TRIGGERED = 2,  /// Trigger edge seen, sampling the second half of the buffer.
+    CAPTURE_DONE = 3,       /// Stopped by master or after the trigger, buffer ready to read.
+  } capture_state_t;
 
-          case 85:  // get Port 0 value
-            if (context.i2c_add == PICO_PORT_ADDRESS)
-            {                            // if command valid following i2c_address
-              lvalue = gpio_get_all();   // Read All GPIO
-              svalue = (uint8_t)lvalue;  // keep only 8 bit
-              sprintf(&rec.data[0], "Cmd %02d,Read Port0 8 bit In: 0x%01x ", cmd, svalue);
-              context.reg[context.reg_address] = svalue;
-            }
-            else
-            {
-              sprintf(&rec.data[0], "Cmd %02d, Not Valid for I2C Pico: 0x%02x,  ", cmd, context.i2c_add);
-              status.cmd = 1;  // raise error flag
-            }
-            enque(&rec);
-            break;
+  /**
+   * @brief Capture of the input ports, started with command 97 and read back with command 98. Port 0 and port 1
+   *        are sampled by an alarm on core 1 at the period of command 92 and 93, into a circular buffer keeping
+   *        the last CAPTURE_SIZE samples. With a trigger edge on the pin of command 94, the capture stops half
+   *        a buffer after the edge, so the buffer holds the inputs before and after the trigger.
+   */
+  static struct
+  {
+    uint16_t buf[CAPTURE_SIZE];  /// Samples, port 0 in bits 7-0, port 1 in bits 15-8.
+    volatile uint32_t count;     /// Samples taken since the start, core 1.
+    volatile uint32_t trigger;   /// Sample count at the trigger edge, core 1.
+    uint32_t period;             /// Sampling period, in us.
+    uint8_t mode;                /// CAPTURE_RUN, CAPTURE_RISING or CAPTURE_FALLING.
+    uint8_t pin;                 /// Trigger Gpio.
+    bool level;                  /// Last level of the trigger pin, core 1.
+    volatile bool stop;          /// Stop requested by master.
+    volatile uint8_t state;      /// capture_state_t.
+    uint32_t read_pos;           /// Next sample read by master with command 98.
+  } capture;
 
-          case 95:  // get Port 1 value
-            if (context.i2c_add == PICO_PORT_ADDRESS)
-            {                           // if command valid following i2c_address
-              lvalue = gpio_get_all();  // Read All GPIO
-              svalue = (uint8_t)(lvalue >> PORT1_OFFSET);
-              sprintf(&rec.data[0], "Cmd %02d, Read Port1 8 bit In: 0x%01x ", cmd, svalue);
-              context.reg[context.reg_address] = svalue;
-            }
-            else
-            {
-              sprintf(&rec.data[0], "Cmd %02d, Not Valid for I2C Pico: 0x%02x,  ", cmd, context.i2c_add);
-              status.cmd = 1;  // raise error flag
-            }
-            enque(&rec);
+  /**
+   * @brief Check if the port capture of command 97 is sampling, the PIO parallel port cannot be started meanwhile.
+   *
+   * @return true capture running or waiting for its trigger
+   */
+  static inline bool capture_running(void)
+  {
+    return capture.state == CAPTURE_RUNNING || capture.state == CAPTURE_TRIGGERED;
+  }
 
-            break;
+  /**
+   * @brief Check if the PIO parallel port owns a port, from command 87 to command 88. The port capture cannot be
+   *        started meanwhile.
+   *
+   * @return true pattern output or PIO capture started and not stopped
+   */
+  static inline bool pattern_active(void)
+  {
+    return pattern.pending ? pattern.mode != PATTERN_STOP : pattern.rate != 0;
+  }
 
-          case 100:  // get statsus register, nothing to do
-            context.reg[REG_STATUS] = status.all_flags;
-            sprintf(&rec.data[0], "Cmd %02d,Status register: 0x%01x ", cmd, context.reg[REG_STATUS]);
-            enque(&rec);
-            break;
-        }
+  /**
+   * @brief State of the power-on configuration saved in flash, read by master with command 104.
+   */
+  typedef enum
+  {
+    CFG_DEFAULT = 0,   /// No saved configuration, default of the I2C address used at boot.
+    CFG_RESTORED = 1,  /// Saved configuration applied at boot.
+    CFG_BUSY = 2,      /// Save or erase requested, in progress on core 1.
+    CFG_SAVED = 3,     /// Current configuration saved, used at next boot.
+    CFG_ERASED = 4,    /// Saved configuration erased, default used at next boot.
+    CFG_FAILED = 5,    /// Flash write failed, core 0 lockout timeout.
+  } cfg_state_t;
 
-        i2c_write_byte(i2c, context.reg[context.reg_address]);
-        sprintf(&rec.data[0], "Read Cmd : %02d , Value: %02d ", cmd, context.reg[context.reg_address]);
-        enque(&rec);
+  #define CFG_SAVE 1  /**< Request to save the current configuration. */
+  #define CFG_ERASE 2 /**< Request to erase the saved configuration. */
 
-        break;
-      case I2C_SLAVE_FINISH:  // master has signalled Stop / Restart
-        context.reg_address_written = false;
-        // sprintf(&rec.data[0],"On i2c_finish");
-        // enque(&rec);
+  /**
+   * @brief Flash configuration request from master, executed by core 1. Core 0 is stopped during the flash write
+   *        by the multicore lockout. The I2C hardware keeps acknowledging writes until the Rx FIFO is full, only
+   *        then the clock is stretched, so the writes are executed after the flash write completes.
+   */
+  static struct
+  {
+    volatile uint8_t request;  /// CFG_SAVE or CFG_ERASE, 0 if none.
+    volatile uint8_t state;    /// cfg_state_t.
+  } flash_cfg;
 
-        break;
-      default:
-        break;
-    }
-  }
+  static volatile bool core1_ready;  // core 1 started, sequence engine available
 
   /**
-   * @brief function who read the 2 externals pins to define the I2C address to use.
-   *        The address = 0x20 + value of 2 externals pins
+   * @brief Check if a request can be sent to core 1 by the SIO FIFO. The FIFO is not used before core 1 is started
+   *        (the launch handshake and the drain of setup_sequence() drop the words), or while a flash request is
+   *        pending: the multicore lockout handshake of core 1 reads its FIFO and discards the other words.
    *
-   * @return uint8_t Address to use for the Pico slave
+   * @return true core 1 started, FIFO is free and no flash request is pending
    */
-  uint8_t read_i2c_address()
+  static inline bool core1_fifo_ready(void)
   {
-    uint8_t io0, io1, I2C_address;
+    return core1_ready && flash_cfg.request == 0 && multicore_fifo_wready();
+  }
 
-    gpio_set_function(I2C_SLAVE_ADDRESS_IO0, GPIO_FUNC_SIO);  // Set mode to software IO Control
-    gpio_set_dir(I2C_SLAVE_ADDRESS_IO0, false);               // Set IO to input
-    gpio_pull_up(I2C_SLAVE_ADDRESS_IO0);                      // Set to pull-up
+  #define WATCH_TIMEOUT_MS 500    /**< Watchdog timeout. */
+  #define WATCH_ALIVE_MS 50       /**< Period of the core 0 alive counter. */
+  #define WATCH_STALL_TICKS 2     /**< Housekeeping ticks without core 0 alive before the watchdog is no more fed. */
+  #define WATCH_MAGIC 0x57444F47u /**< "WDOG", scratch 0 = magic ^ scratch 1 ^ scratch 2 ^ scratch 3. */
+  #define WATCH_NO_LAST 0xFFFF    /**< No last command, boot was not a watchdog reset. */
 
-    gpio_set_function(I2C_SLAVE_ADDRESS_IO1, GPIO_FUNC_SIO);  // Set mode to software IO Control
-    gpio_set_dir(I2C_SLAVE_ADDRESS_IO1, false);               // Set IO to input
-    gpio_pull_up(I2C_SLAVE_ADDRESS_IO1);                      // Set to pull-up
+  /**
+   * @brief Watchdog state. The output image and the last command are kept in the watchdog scratch registers 0-3,
+   *        which are not cleared by a watchdog reset (scratch 4-7 are used by the SDK).
+   */
+  static struct
+  {
+    volatile uint32_t core0_alive;  /// Incremented by the core 0 timer, the watchdog is fed by core 1 only if it moves.
+    repeating_timer_t timer;        /// Core 0 alive timer.
+    uint16_t last;                  /// Last command and data before the watchdog reset, WATCH_NO_LAST if none.
+  } watch;
 
-    io0 = gpio_get(I2C_SLAVE_ADDRESS_IO0);
-    io1 = gpio_get(I2C_SLAVE_ADDRESS_IO1);
-    I2C_address = I2C_OFFSET_ADDRESS + (io1 << 1) + io0;
-    return I2C_address;
-  }
+  #define TIMING_WRITE 0    /**< Timing of write command, from data byte received to end of action. */
+  #define TIMING_READ 1     /**< Timing of read command, from RD_REQ to Tx FIFO written (clock stretching). */
+  #define TIMING_BUCKETS 16 /**< Number of log2 buckets of the timing histograms. */
 
   /**
-   * @brief Set the up slave object
-   *
-   * @param i2c_add Address to use to configure the I2C slave
+   * @brief Execution time statistics of one command, in CPU cycles (clk_sys).
    */
-  static void setup_slave(uint8_t i2c_add)
+  typedef struct
   {
-    gpio_init(I2C_SLAVE_SDA_PIN);
-    gpio_set_function(I2C_SLAVE_SDA_PIN, GPIO_FUNC_I2C);
-    gpio_pull_up(I2C_SLAVE_SDA_PIN);
+    uint32_t count;  /// Number of execution.
+    uint32_t min;    /// Minimum time.
+    uint32_t max;    /// Maximum time.
+    uint32_t sum;    /// Sum of time, used to compute the mean.
+  } timing_t;
 
-    gpio_init(I2C_SLAVE_SCL_PIN);
-    gpio_set_function(I2C_SLAVE_SCL_PIN, GPIO_FUNC_I2C);
-    gpio_pull_up(I2C_SLAVE_SCL_PIN);
-
-    i2c_init(i2c0, I2C_BAUDRATE);
+  /**
+   * @brief I2C handler timing statistics, measured with the core 0 SysTick counter.
+   *        Histogram bucket n counts the executions taking from 2^(n-1) to 2^n - 1 cycles.
+   */
+  static struct
+  {
+    timing_t cmd[CMD_TABLE_SIZE];           /// Statistics per command.
+    uint32_t histogram[2][TIMING_BUCKETS];  /// Histogram of write and read time.
+    volatile bool dump_request;             /// Dump of statistics to serial port requested.
+  } timing;
 
-    // configure I2C0 for slave mode
-    i2c_slave_init(i2c0, i2c_add, &i2c_slave_handler);
-    // i2c_slave_init(i2c0, I2C_SLAVE_ADDRESS, &i2c_slave_handler);
+  /**
+   * @brief Start the SysTick counter of the calling core, used as cycle counter for the ISR timing.
+   */
+  static void timing_init(void)
+  {
+    systick_hw->csr = 0;
+    systick_hw->rvr = M0PLUS_SYST_RVR_BITS;  // 24 bit, full range
+    systick_hw->cvr = 0;
+    systick_hw->csr = M0PLUS_SYST_CSR_CLKSOURCE_BITS | M0PLUS_SYST_CSR_ENABLE_BITS;  // count clk_sys cycles
   }
 
-  /// Used on in development to loopback I2C to simulate master talking to slave
+  /**
+   * @brief Clear all timing statistics.
+   */
+  static void __not_in_flash_func(timing_clear)(void)
+  {
+    memset(&timing.cmd[0], 0, sizeof(timing.cmd));
+    memset(&timing.histogram[0][0], 0, sizeof(timing.histogram));
+  }
 
-  #ifdef USE_MASTER_LOOPBACK
+  /**
+   * @brief Record the execution time of a command, from start to now.
+   *
+   * @param cmd command number
+   * @param type TIMING_WRITE or TIMING_READ
+   * @param start SysTick value at handler entry
+   */
+  static inline void record_timing(uint8_t cmd, uint type, uint32_t start)
+  {
+    uint32_t cycles = (start - systick_hw->cvr) & M0PLUS_SYST_CVR_BITS;  // SysTick is counting down
+    timing_t* t = &timing.cmd[cmd];
+    uint bucket = cycles ? 32 - __builtin_clz(cycles) : 0;
 
-  static const uint I2C_MASTER_SDA_PIN = 6;  /// Master SDA pin
-  static const uint I2C_MASTER_SCL_PIN = 7;  /// Master SCL pins
+    if (t->count == 0 || cycles < t->min)
+    {
+      t->min = cycles;
+    }
+    if (cycles > t->max)
+    {
+      t->max = cycles;
+    }
+    t->count++;
+    t->sum += cycles;
+    timing.histogram[type][bucket < TIMING_BUCKETS ? bucket : TIMING_BUCKETS - 1]++;
+  }
 
   /**
-   * @brief Set the up master object
+   * @brief Store a 32 bit value in little endian order
    *
+   * @param buf destination buffer
+   * @param value value to store
+   */
+  static inline void put_le32(uint8_t* buf, uint32_t value)
+  {
+    buf[0] = (uint8_t)value;
+    buf[1] = (uint8_t)(value >> 8);
+    buf[2] = (uint8_t)(value >> 16);
+    buf[3] = (uint8_t)(value >> 24);
+  }
+
+  /**
+   * @brief Pin state bitmaps of the pads, read by master with command 26 and 16. Output and direction bitmaps are the
+   *        SIO registers. The pad bitmaps are updated on each pad write, from the I2C ISR or the sequence engine on
+   *        core 1, under a hardware spin lock.
    */
-  static void setup_master()
+  static struct
   {
-    gpio_init(I2C_MASTER_SDA_PIN);
-    gpio_set_function(I2C_MASTER_SDA_PIN, GPIO_FUNC_I2C);
-    // pull-ups are already active on slave side, this is just a fail-safe in case the wiring is faulty
-    gpio_pull_up(I2C_MASTER_SDA_PIN);
+    uint32_t pull_up;    /// Pull-up of GP0 to GP29, 1 = active.
+    uint32_t pull_down;  /// Pull-down of GP0 to GP29, 1 = active.
+    uint32_t drive[2];   /// Drive strength, 2 bits per pin (GPIO_DRIVE_STRENGTH_xxx), GP0-15 then GP16-29.
+    spin_lock_t* lock;   /// Lock of the bitmaps update.
+  } pin_state;
 
-    gpio_init(I2C_MASTER_SCL_PIN);
-    gpio_set_function(I2C_MASTER_SCL_PIN, GPIO_FUNC_I2C);
-    gpio_pull_up(I2C_MASTER_SCL_PIN);
+  /**
+   * @brief Update the pin state bitmaps from the pad register of one pin.
+   *
+   * @param pin gpio number
+   */
+  static void __not_in_flash_func(pin_state_update)(uint pin)
+  {
+    uint32_t pad = pads_bank0_hw->io[pin];
+    uint32_t bit = 1ul << pin;
+    uint shift = (pin & 15) * 2;
+    uint32_t drive = (pad & PADS_BANK0_GPIO0_DRIVE_BITS) >> PADS_BANK0_GPIO0_DRIVE_LSB;
+
+    uint32_t save = spin_lock_blocking(pin_state.lock);
+    pin_state.pull_up = (pad & PADS_BANK0_GPIO0_PUE_BITS) ? pin_state.pull_up | bit : pin_state.pull_up & ~bit;
+    pin_state.pull_down = (pad & PADS_BANK0_GPIO0_PDE_BITS) ? pin_state.pull_down | bit : pin_state.pull_down & ~bit;
+    pin_state.drive[pin >> 4] = (pin_state.drive[pin >> 4] & ~(3ul << shift)) | (drive << shift);
+    spin_unlock(pin_state.lock, save);
+  }
 
-    i2c_init(i2c1, I2C_BAUDRATE);
+  /**
+   * @brief Build the pin state bitmaps from all pad registers. Called once at boot, before the I2C slave is started.
+   */
+  static void pin_state_load(void)
+  {
+    pin_state.lock = spin_lock_instance((uint)spin_lock_claim_unused(true));
+    for (uint pin = 0; pin < NUM_BANK0_GPIOS; pin++)
+    {
+      pin_state_update(pin);
+    }
   }
 
   /**
-   * @brief send i2c data on the master pins
+   * @brief Set the drive strength of a pad. Same as gpio_set_drive_strength(), but inlined so the ISR stays in RAM.
    *
-   * @param cmd   commandto send
-   * @param wdata data to send
+   * @param pin gpio number
+   * @param strength drive strength (GPIO_DRIVE_STRENGTH_xxx)
    */
-  static void send_master(uint8_t cmd, uint16_t wdata)
+  static inline void pad_set_drive(uint pin, uint32_t strength)
   {
-    // Writing to A register
-    int count;
-    uint8_t buf[3];
-    int buflgth;  // contains size of the buffer
+    hw_write_masked(&pads_bank0_hw->io[pin], strength << PADS_BANK0_GPIO0_DRIVE_LSB, PADS_BANK0_GPIO0_DRIVE_BITS);
+    pin_state_update(pin);
+  }
 
-    buflgth = 2;
-    buf[0] = cmd;    // command
-    buf[1] = wdata;  // gpio
+  /**
+   * @brief Set the pull-up and pull-down of a pad. Same as gpio_set_pulls(), but inlined so the ISR stays in RAM.
+   *
+   * @param pin gpio number
+   * @param up true to enable pull-up
+   * @param down true to enable pull-down
+   */
+  static inline void pad_set_pulls(uint pin, bool up, bool down)
+  {
+    hw_write_masked(&pads_bank0_hw->io[pin], (up ? PADS_BANK0_GPIO0_PUE_BITS : 0) | (down ? PADS_BANK0_GPIO0_PDE_BITS : 0),
+                    PADS_BANK0_GPIO0_PUE_BITS | PADS_BANK0_GPIO0_PDE_BITS);
+    pin_state_update(pin);
+  }
+  /**
+   * @brief Enable or disable the rising and falling edge interrupts of a pin on core 0. Same as gpio_set_irq_enabled(),
+   *        but inlined so the ISR stays in RAM. Stale edges are cleared before the interrupt is enabled.
+   *
+   * @param pin gpio number
+   * @param enable true to enable the interrupts
+   */
+  static inline void pad_set_edge_irq(uint pin, bool enable)
+  {
+    uint32_t events = (uint32_t)(GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL) << (4 * (pin % 8));
 
-    count = i2c_write_blocking(i2c1, context.i2c_add, buf, buflgth, false);
-    if (count < 0)
+    io_bank0_hw->intr[pin / 8] = events;  // write 1 to clear
+    if (enable)
     {
-      puts("Couldn't write Register to slave");
-      return;
+      hw_set_bits(&io_bank0_hw->proc0_irq_ctrl.inte[pin / 8], events);
+    }
+    else
+    {
+      hw_clear_bits(&io_bank0_hw->proc0_irq_ctrl.inte[pin / 8], events);
     }
-    printf("MAS: Write at register 0x%02d: %02d\n", buf[0], buf[1]);
-
-    uint8_t ird[2];
-    i2c_write_blocking(i2c1, context.i2c_add, buf, 1, false);
-    i2c_read_blocking(i2c1, context.i2c_add, ird, buflgth - 1, false);
-
-    printf("MAS:Read Register 0x%02d = %d \r\n", cmd, ird[0]);
   }
 
-  #endif
 
   /**
-   * @brief main loop to execute i2c command from master. Pico les is flashing to indicate heartbeat
+   * @brief CRC-8 table of the SMBus PEC (polynomial x^8 + x^2 + x + 1, initial value 0). In RAM with the ISR.
+   */
+  static const uint8_t __not_in_flash("pec") crc8_table[256] = {
+      0x00, 0x07, 0x0e, 0x09, 0x1c, 0x1b, 0x12, 0x15, 0x38, 0x3f, 0x36, 0x31, 0x24, 0x23, 0x2a, 0x2d,
+      0x70, 0x77, 0x7e, 0x79, 0x6c, 0x6b, 0x62, 0x65, 0x48, 0x4f, 0x46, 0x41, 0x54, 0x53, 0x5a, 0x5d,
+      0xe0, 0xe7, 0xee, 0xe9, 0xfc, 0xfb, 0xf2, 0xf5, 0xd8, 0xdf, 0xd6, 0xd1, 0xc4, 0xc3, 0xca, 0xcd,
+      0x90, 0x97, 0x9e, 0x99, 0x8c, 0x8b, 0x82, 0x85, 0xa8, 0xaf, 0xa6, 0xa1, 0xb4, 0xb3, 0xba, 0xbd,
+      0xc7, 0xc0, 0xc9, 0xce, 0xdb, 0xdc, 0xd5, 0xd2, 0xff, 0xf8, 0xf1, 0xf6, 0xe3, 0xe4, 0xed, 0xea,
+      0xb7, 0xb0, 0xb9, 0xbe, 0xab, 0xac, 0xa5, 0xa2, 0x8f, 0x88, 0x81, 0x86, 0x93, 0x94, 0x9d, 0x9a,
+      0x27, 0x20, 0x29, 0x2e, 0x3b, 0x3c, 0x35, 0x32, 0x1f, 0x18, 0x11, 0x16, 0x03, 0x04, 0x0d, 0x0a,
+      0x57, 0x50, 0x59, 0x5e, 0x4b, 0x4c, 0x45, 0x42, 0x6f, 0x68, 0x61, 0x66, 0x73, 0x74, 0x7d, 0x7a,
+      0x89, 0x8e, 0x87, 0x80, 0x95, 0x92, 0x9b, 0x9c, 0xb1, 0xb6, 0xbf, 0xb8, 0xad, 0xaa, 0xa3, 0xa4,
+      0xf9, 0xfe, 0xf7, 0xf0, 0xe5, 0xe2, 0xeb, 0xec, 0xc1, 0xc6, 0xcf, 0xc8, 0xdd, 0xda, 0xd3, 0xd4,
+      0x69, 0x6e, 0x67, 0x60, 0x75, 0x72, 0x7b, 0x7c, 0x51, 0x56, 0x5f, 0x58, 0x4d, 0x4a, 0x43, 0x44,
+      0x19, 0x1e, 0x17, 0x10, 0x05, 0x02, 0x0b, 0x0c, 0x21, 0x26, 0x2f, 0x28, 0x3d, 0x3a, 0x33, 0x34,
+      0x4e, 0x49, 0x40, 0x47, 0x52, 0x55, 0x5c, 0x5b, 0x76, 0x71, 0x78, 0x7f, 0x6a, 0x6d, 0x64, 0x63,
+      0x3e, 0x39, 0x30, 0x37, 0x22, 0x25, 0x2c, 0x2b, 0x06, 0x01, 0x08, 0x0f, 0x1a, 0x1d, 0x14, 0x13,
+      0xae, 0xa9, 0xa0, 0xa7, 0xb2, 0xb5, 0xbc, 0xbb, 0x96, 0x91, 0x98, 0x9f, 0x8a, 0x8d, 0x84, 0x83,
+      0xde, 0xd9, 0xd0, 0xd7, 0xc2, 0xc5, 0xcc, 0xcb, 0xe6, 0xe1, 0xe8, 0xef, 0xfa, 0xfd, 0xf4, 0xf3,
+  };
+
+  /**
+   * @brief Update a SMBus PEC with a block of bytes.
    *
-   * @return int   do nothing
+   * @param crc PEC of the previous bytes, 0 at the start of the transfer
+   * @param data bytes
+   * @param len number of bytes
+   * @return uint8_t PEC of all the bytes
    */
-  int main()
+  static inline uint8_t crc8(uint8_t crc, const uint8_t* data, uint len)
   {
-    MESSAGE rec;
-    uint16_t ctr;    // counter used for flashing led
-    uint16_t pulse;  // limit for flashing led frequency
+    while (len--)
+    {
+      crc = crc8_table[crc ^ *data++];
+    }
+    return crc;
+  }
 
-    status.all_flags = 0;
-    pulse = 200;  // slow led flashing frequency
+  /**
+   * @brief Append the PEC to the response of a read in PEC mode. A single byte read is moved to the Tx buffer.
+   *        The PEC covers the address with write bit, the command byte, the address with read bit and the data.
+   *
+   * @param ctx slave context
+   * @param cmd command read
+   */
+  static void __not_in_flash_func(pec_append)(slave_context_t* ctx, uint8_t cmd)
+  {
+    uint8_t head[3] = {(uint8_t)(ctx->i2c_add << 1), cmd, (uint8_t)((ctx->i2c_add << 1) | 1)};
 
-    if (watchdog_caused_reboot())
+    if (ctx->tx_len == 0)
     {
-      status.watch = 1;
-      pulse = 50;  // fast flashing led to indicate watchdog trig
+      ctx->tx_buf[0] = ctx->reg[cmd];
+      ctx->tx_len = 1;
+      ctx->tx_pos = 0;
     }
+    ctx->tx_buf[ctx->tx_len] = crc8(crc8(0, head, sizeof(head)), ctx->tx_buf, ctx->tx_len);
+    ctx->tx_len++;
+  }
 
-    gpio_init_mask(GPIO_BOOT_MASK);  // set which lines will be GPIO
-    init_queue();                    // initialise queue for serial message
-    stdio_init_all();
+  /**
+   * @brief Fill the Tx FIFO with the next bytes of a multi-byte read. Called again on the next
+   *        RD_REQ when the master read more bytes than the FIFO could hold.
+   *
+   * @param ctx slave context
+   * @param i2c i2c instance used
+   */
+  static void __not_in_flash_func(send_tx_buf)(slave_context_t* ctx, i2c_inst_t* i2c)
+  {
+    if (ctx->tx_pos == 0 && ctx->tx_len > TX_DMA_MIN && i2c_slave_dma_send(i2c, ctx->tx_buf, ctx->tx_len))
+    {
+      stats.tx_bytes += ctx->tx_len;
+      ctx->tx_pos = ctx->tx_len;  // whole buffer sent by DMA, no interrupt until the end
+      return;
+    }
+    if (ctx->tx_pos >= ctx->tx_len)
+    {
+      i2c_write_byte(i2c, 0x00);  // master read past the end of data
+      stats.tx_bytes++;
+      return;
+    }
+    while ((ctx->tx_pos < ctx->tx_len) && (i2c_get_write_available(i2c) > 0))
+    {
+      i2c_write_byte(i2c, ctx->tx_buf[ctx->tx_pos++]);
+      stats.tx_bytes++;
+    }
+  }
 
-    fprintf(stdout, "Slave Version: %d.%d\n", IO_SLAVE_VERSION_MAJOR, IO_SLAVE_VERSION_MINOR);
+  /**
+   * @brief Record the error of a rejected command. The status register command flag is raised and the
+   *        error code is kept until the master reads it with command 101.
+   *
+   * @param ctx slave context
+   * @param error error code (ERR_xxx)
+   */
+  static inline void set_error(slave_context_t* ctx, error_code_t error)
+  {
+    ctx->error = error;
+    status.cmd = 1;  // raise error flag
+    stats.rejected++;
+  }
 
-    context.i2c_add = read_i2c_address();  // Setup I2C Address
+  /**
+   * @brief Lines of the second slave on i2c1, refused to the commands and skipped by the port commands so the
+   *        pads and the pin function of the bus are never changed.
+   *
+   * @return uint32_t mask of the lines, 0 when the second slave is not used
+   */
+  static inline uint32_t slave1_mask(void)
+  {
+    #ifdef USE_I2C_SLAVE1
+        return 1u << I2C_SLAVE1_SDA_PIN | 1u << I2C_SLAVE1_SCL_PIN;
+    #else
+        return 0;
+    #endif
+  }
 
-    sprintf(&rec.data[0], "Pico Slave boot for I2C address 0x%02x", context.i2c_add);
-    enque(&rec);  // Add message to the queue
+  /*
+  Command actions, called from the I2C ISR through the command table.
+  Write actions are called for each data byte and return the value to log as result.
+  Read actions return the value sent to master, which is also saved on the command register.
+  */
 
-    switch (context.i2c_add)
-    {  // Config following i2C Address
+  /// Command 10, 11: Clear or Set GPx
+  static uint8_t __not_in_flash_func(cmd_gpio_put)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    gpio_put(arg, cmd == 11);
+    return 0;
+  }
 
-      case 0x21:  // IO slave
-        gpio_set_dir_masked(GPIO_SET_DIR_MASK, GPIO_SLV1_DIR_MASK);
-        gpio_put_masked(GPIO_SET_DIR_MASK, GPIO_SLV1_OUT_MASK);
-        sprintf(&rec.data[0], "Config for I2C address 0x%02x completed", context.i2c_add);
-        break;
+  /// Command 12: Clear Bank, bank 0 if data < 10
+  static uint8_t __not_in_flash_func(cmd_clear_bank)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    gpio_put_masked((arg < 10 ? GPIO_BANK0_MASK : GPIO_BANK1_MASK) & ~slave1_mask(), 0x00ul);
+    return 0;
+  }
 
-      case 0x22:
-      case 0x23:  // Relay slave
-        gpio_set_dir_masked(GPIO_SET_DIR_MASK, GPIO_SLV2_DIR_MASK);
-        gpio_put_masked(GPIO_SET_DIR_MASK, GPIO_SLV2_OUT_MASK);
-        sprintf(&rec.data[0], "Config for I2C address 0x%02x completed", context.i2c_add);
-        break;
+  /// Command 20, 21: Set GPx direction to Output or Input
+  static uint8_t __not_in_flash_func(cmd_gpio_dir)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    gpio_set_dir(arg, cmd == 20);
+    return 0;
+  }
 
-      default:  // not defined yet
-        sprintf(&rec.data[0], "I2C address not supported for device at address  0x%02x", context.i2c_add);
-        status.cfg = 1;  // raise error flag
-        break;
-    }
-    enque(&rec);  // Add message to the queue
+  /// Command 30 to 33: Set GPx strength to 2mA, 4mA, 8mA or 12mA
+  static uint8_t __not_in_flash_func(cmd_gpio_drive)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    pad_set_drive(arg, cmd - 30);
+    return 0;
+  }
 
-    setup_slave(context.i2c_add);
-    // setup_master();  // for development only, using loopback
+  /// Command 41, 50, 51: Set pull-up, disable pulls or set pull-down
+  static uint8_t __not_in_flash_func(cmd_gpio_pulls)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    pad_set_pulls(arg, cmd == 41, cmd == 51);
+    return 0;
+  }
+
+  /// Command 61: Set GPx to PAD state saved by command 60
+  static uint8_t __not_in_flash_func(cmd_gpio_pad)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    hw_write_masked(&pads_bank0_hw->io[arg], ctx->reg[cmd - 1], 0xfful);  // Set Pad state
+    pin_state_update(arg);
+    return ctx->reg[cmd - 1];
+  }
+
+  /// Command 80, 90: Set direction of port 0 or port 1 using 8 bit mask, the second slave lines are not changed
+  static uint8_t __not_in_flash_func(cmd_port_dir)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    if (cmd == 80)
+    {
+      gpio_set_dir_masked(PORT0_MASK & ~slave1_mask(), arg);
+    }
+    else
+    {
+      gpio_set_dir_masked(PORT1_MASK & ~slave1_mask(), (uint32_t)arg << PORT1_OFFSET);
+    }
+    return 0;
+  }
+
+  /// Command 81, 91: Set output on 8 bit port 0 or port 1, the second slave lines are not changed
+  static uint8_t __not_in_flash_func(cmd_port_put)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    if (cmd == 81)
+    {
+      gpio_put_masked(PORT0_MASK & ~slave1_mask(), arg);
+    }
+    else
+    {
+      gpio_put_masked(PORT1_MASK & ~slave1_mask(), (uint32_t)arg << PORT1_OFFSET);
+    }
+    return 0;
+  }
+
+  /// Command 102: Set I2C speed mode, applied by main loop after the end of transfer
+  static uint8_t __not_in_flash_func(cmd_set_speed)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    ctx->speed_request = arg;
+    ctx->speed_pending = true;
+    return 0;
+  }
+
+  /// Command 103: Set PEC mode, 1: writes checked and reads followed by a PEC byte. Applied from the next transfer
+  static uint8_t __not_in_flash_func(cmd_set_pec)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    ctx->pec = arg;
+    return 0;
+  }
+
+  /// Command 103: get PEC mode
+  static uint8_t __not_in_flash_func(cmd_get_pec)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    return ctx->pec;
+  }
+
+  /// Command 01, 02: get Major or Minor Version
+  static uint8_t __not_in_flash_func(cmd_get_version)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    return cmd == 1 ? IO_SLAVE_VERSION_MAJOR : IO_SLAVE_VERSION_MINOR;
+  }
+
+  /**
+   * @brief Get the debounced value of all GPIO, the raw value when the filter is off.
+   *
+   * @return uint32_t value of GP0 to GP29
+   */
+  static inline uint32_t debounce_get_all(void)
+  {
+    return debounce.window != 0 ? debounce.stable : gpio_get_all();
+  }
+
+  /// Command 13: read Bank status, bank 0 if data < 10. Command 19: read filtered Bank status
+  static uint8_t __not_in_flash_func(cmd_get_bank)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    uint32_t lvalue = cmd == 19 ? debounce_get_all() : gpio_get_all();  // Read All GPIO
+    return arg < 10 ? (uint8_t)lvalue : (uint8_t)(lvalue >> 10);
+  }
+
+  /// Command 15: read True value of GPx, command 18: read filtered value of GPx
+  static uint8_t __not_in_flash_func(cmd_gpio_get)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    return cmd == 18 ? (debounce_get_all() >> arg) & 1 : gpio_get(arg);
+  }
+
+  /// Command 17: set debounce time in ms of the filtered reads, 0: filter off. Sampling is started by core 1.
+  static uint8_t __not_in_flash_func(cmd_debounce)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    if (arg != 0 && !core1_fifo_ready())
+    {
+      set_error(ctx, ERR_DATA);  // core 1 busy with previous request
+      return 1;
+    }
+    debounce.window = arg;
+    if (arg != 0)
+    {
+      sio_hw->fifo_wr = DEBOUNCE_START;  // ignored by core 1 if already sampling
+      __sev();
+    }
+    return 0;
+  }
+
+  /**
+   * @brief Snapshot latched by command 108, returned by the next read of command 16 instead of the present state.
+   *        Broadcast on the general call address, all slaves latch their inputs on the same I2C transfer.
+   */
+  static struct
+  {
+    volatile bool latched;  /// Latched snapshot not yet read.
+    uint32_t input;         /// Input value of GP0 to GP29 at the latch.
+    uint32_t dir;           /// Direction of GP0 to GP29 at the latch.
+  } snapshot;
+
+  /**
+   * @brief Command 16: Sample the state of all GPIO into the Tx buffer. Input and direction are read
+   *        at the same instant, the pull-up and pull-down state come from the pin state bitmaps.
+   *        A snapshot latched by command 108 is returned once, instead of the present state.
+   *        Format: input (4 bytes), direction (4 bytes), pull-up (4 bytes), pull-down (4 bytes), LSB first.
+   */
+  static uint8_t __not_in_flash_func(cmd_get_snapshot)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    uint32_t input = gpio_get_all();
+    uint32_t dir = sio_hw->gpio_oe;
+
+    if (snapshot.latched)
+    {
+      input = snapshot.input;
+      dir = snapshot.dir;
+      snapshot.latched = false;
+    }
+
+    put_le32(&ctx->tx_buf[0], input);
+    put_le32(&ctx->tx_buf[4], dir);
+    put_le32(&ctx->tx_buf[8], pin_state.pull_up);
+    put_le32(&ctx->tx_buf[12], pin_state.pull_down);
+    ctx->tx_len = 16;
+    ctx->tx_pos = 0;
+    return ctx->tx_len;
+  }
+
+  /**
+   * @brief Command 26: Read the pin state bitmaps of all GPIO, used for a configuration audit in one transfer.
+   *        Format: output, direction, pull-up, pull-down (4 bytes each), drive strength of GP0-15 and GP16-29
+   *        (4 bytes each, 2 bits per pin), LSB first.
+   */
+  static uint8_t __not_in_flash_func(cmd_get_pin_state)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    put_le32(&ctx->tx_buf[0], sio_hw->gpio_out);
+    put_le32(&ctx->tx_buf[4], sio_hw->gpio_oe);
+    put_le32(&ctx->tx_buf[8], pin_state.pull_up);
+    put_le32(&ctx->tx_buf[12], pin_state.pull_down);
+    put_le32(&ctx->tx_buf[16], pin_state.drive[0]);
+    put_le32(&ctx->tx_buf[20], pin_state.drive[1]);
+    ctx->tx_len = 24;
+    ctx->tx_pos = 0;
+    return ctx->tx_len;
+  }
+
+  /// Command 25: get GPx direction
+  static uint8_t __not_in_flash_func(cmd_gpio_get_dir)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    return gpio_get_dir(arg);
+  }
+
+  /// Command 35: get GPx drive strength
+  static uint8_t __not_in_flash_func(cmd_gpio_get_drive)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    return (pads_bank0_hw->io[arg] & PADS_BANK0_GPIO0_DRIVE_BITS) >> PADS_BANK0_GPIO0_DRIVE_LSB;
+  }
+
+  /// Command 45, 55: get GPx pull-up or pull-down
+  static uint8_t __not_in_flash_func(cmd_gpio_get_pull)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    return (pads_bank0_hw->io[arg] & (cmd == 45 ? PADS_BANK0_GPIO0_PUE_BITS : PADS_BANK0_GPIO0_PDE_BITS)) != 0;
+  }
+
+  /// Command 65: get GPx PAD state
+  static uint8_t __not_in_flash_func(cmd_gpio_get_pad)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    return pads_bank0_hw->io[arg] & 0xff;
+  }
+
+  /// Command 85, 95: get port 0 or port 1 value, command 86, 96: get filtered port 0 or port 1 value
+  static uint8_t __not_in_flash_func(cmd_port_get)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    uint32_t lvalue = (cmd == 86 || cmd == 96) ? debounce_get_all() : gpio_get_all();  // Read All GPIO
+    return (cmd == 85 || cmd == 86) ? (uint8_t)lvalue : (uint8_t)(lvalue >> PORT1_OFFSET);
+  }
+
+  /// Command 100: get status register
+  static uint8_t __not_in_flash_func(cmd_get_status)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    return status.all_flags;
+  }
+
+  /// Command 70, 71: Clear or Set GPx in shadow output register
+  static uint8_t __not_in_flash_func(cmd_shadow_put)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    if (cmd == 71)
+    {
+      shadow.out |= 1ul << arg;
+    }
+    else
+    {
+      shadow.out &= ~(1ul << arg);
+    }
+    return 0;
+  }
+
+  /// Command 72, 73: Set GPx direction to Output or Input in shadow direction register
+  static uint8_t __not_in_flash_func(cmd_shadow_dir)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    if (cmd == 72)
+    {
+      shadow.dir |= 1ul << arg;
+    }
+    else
+    {
+      shadow.dir &= ~(1ul << arg);
+    }
+    return 0;
+  }
+
+  /// Command 74, 78: Set 8 bit port 0 or port 1 in shadow output register
+  static uint8_t __not_in_flash_func(cmd_shadow_port)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    if (cmd == 74)
+    {
+      shadow.out = (shadow.out & ~PORT0_MASK) | arg;
+    }
+    else
+    {
+      shadow.out = (shadow.out & ~PORT1_MASK) | ((uint32_t)arg << PORT1_OFFSET);
+    }
+    return 0;
+  }
+
+  /**
+   * @brief Lines applied by the shadow commit: the GPIO_SET_DIR_MASK lines except the board led, the I2C pins,
+   *        the address strap pins and the INT line, which are owned by the firmware.
+   *
+   * @return uint32_t mask of the lines
+   */
+  static inline uint32_t shadow_mask(void)
+  {
+    uint32_t mask = GPIO_SET_DIR_MASK;
+
+    mask &= ~(1u << PICO_DEFAULT_LED_PIN | 1u << I2C_SLAVE_SDA_PIN | 1u << I2C_SLAVE_SCL_PIN);
+    mask &= ~(1u << I2C_SLAVE_ADDRESS_IO0 | 1u << I2C_SLAVE_ADDRESS_IO1);
+    mask &= ~slave1_mask();
+    #ifdef USE_MASTER_LOOPBACK
+        mask &= ~(1u << 6 | 1u << 7);  // loopback master of the slave_bench target
+    #endif
+    #if I2C_SLAVE_INT_PIN >= 0
+        mask &= ~(1u << I2C_SLAVE_INT_PIN);
+    #endif
+    return mask;
+  }
+
+  /// Command 76: Commit shadow registers, all outputs are updated at the same time, then all directions
+  static uint8_t __not_in_flash_func(cmd_shadow_commit)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    uint32_t mask = shadow_mask();
+
+    gpio_put_masked(mask, shadow.out);  // output value ready before line is driven
+    gpio_set_dir_masked(mask, shadow.dir);
+    return 0;
+  }
+
+  /// Command 77: Load shadow registers with the present outputs and directions
+  static uint8_t __not_in_flash_func(cmd_shadow_load)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    shadow.out = sio_hw->gpio_out;
+    shadow.dir = sio_hw->gpio_oe;
+    return 0;
+  }
+
+  /// Command 75: read shadow registers, multi-byte read: output (4 bytes), direction (4 bytes), LSB first
+  static uint8_t __not_in_flash_func(cmd_shadow_get)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    put_le32(&ctx->tx_buf[0], shadow.out);
+    put_le32(&ctx->tx_buf[4], shadow.dir);
+    ctx->tx_len = 8;
+    ctx->tx_pos = 0;
+    return ctx->tx_len;
+  }
+
+  /// Command 56: enable edge notification on GPx, Command 57: disable
+  static uint8_t __not_in_flash_func(cmd_edge_enable)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    bool enable = (cmd == 56);
+
+    if (enable)
+    {
+      edge.enabled |= 1ul << arg;
+    }
+    else
+    {
+      edge.enabled &= ~(1ul << arg);
+    }
+    pad_set_edge_irq(arg, enable);
+    return 0;
+  }
+
+  /// Command 58: read and clear input changes, multi-byte read: changed pins, time of last change (us),
+  /// number of edges, present input (4 bytes each, LSB first). INT line is released.
+  static uint8_t __not_in_flash_func(cmd_get_changes)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    uint32_t irq_status = save_and_disable_interrupts();  // changes latched and cleared together
+
+    put_le32(&ctx->tx_buf[0], edge.changed);
+    put_le32(&ctx->tx_buf[4], edge.time);
+    put_le32(&ctx->tx_buf[8], edge.count);
+    put_le32(&ctx->tx_buf[12], gpio_get_all());
+    edge.changed = 0;
+    edge.count = 0;
+    status.change = 0;
+    #if I2C_SLAVE_INT_PIN >= 0
+        sio_hw->gpio_oe_clr = 1ul << I2C_SLAVE_INT_PIN;  // release INT line
+    #endif
+    restore_interrupts(irq_status);
+
+    ctx->tx_len = 16;
+    ctx->tx_pos = 0;
+    return ctx->tx_len;
+  }
+
+  /// Command 82: append a byte to the pattern buffer, burst write to load the pattern
+  static uint8_t __not_in_flash_func(cmd_pattern_put)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    if (pattern.len >= PATTERN_SIZE)
+    {
+      set_error(ctx, ERR_DATA);  // pattern buffer full
+      return 1;
+    }
+    pattern.buf[pattern.len++] = arg;
+    return 0;
+  }
+
+  /// Command 82: read back the pattern or the data captured, multi-byte read of up to 64 bytes from the
+  /// last read position
+  static uint8_t __not_in_flash_func(cmd_pattern_get)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    uint32_t avail = (pattern.mode & PATTERN_CAPTURE) ? port_pio_count() : pattern.len;
+    uint32_t n = avail > pattern.read_pos ? avail - pattern.read_pos : 0;
+
+    n = n > TX_BUF_SIZE ? TX_BUF_SIZE : n;
+    memcpy(&ctx->tx_buf[0], &pattern.buf[pattern.read_pos], n);
+    pattern.read_pos += n;
+    ctx->tx_len = n;
+    ctx->tx_pos = 0;
+    return ctx->tx_len;
+  }
+
+  /**
+   * @brief Lines taken by the PIO parallel port in a command 87 mode: the 8 port pins and the strobe pin.
+   *
+   * @param mode command 87 mode
+   * @return uint32_t mask of the lines
+   */
+  static inline uint32_t pattern_pins(uint8_t mode)
+  {
+    uint32_t mask = (mode & PATTERN_PORT1) ? PORT1_MASK : PORT0_MASK;
+
+    if (mode & PATTERN_STROBE)
+    {
+      mask |= (mode & PATTERN_PORT1) ? 1u << (PORT1_OFFSET + 8) : 1u << 8;
+    }
+    return mask;
+  }
+
+  /// Command 87: start the pattern output or the capture, refused with a rate of 0 kHz, while the port capture of
+  /// command 97 is running or when the port or its strobe uses a line of the second slave.
+  /// Command 88: stop and clear the pattern buffer
+  static uint8_t __not_in_flash_func(cmd_pattern_run)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    if (cmd == 88)
+    {
+      pattern.mode = PATTERN_STOP;
+      pattern.len = 0;
+    }
+    else if (capture_running() || (ctx->reg[84] == 0 && ctx->reg[83] == 0) || (pattern_pins(arg) & slave1_mask()))
+    {
+      set_error(ctx, ERR_DATA);  // port capture of command 97 in progress, no rate set by command 83 and 84, or
+      return 1;                  // port or strobe on a line of the second slave
+    }
+    else
+    {
+      pattern.mode = arg;
+      pattern.khz = (uint16_t)ctx->reg[84] << 8 | ctx->reg[83];  // rate of the master starting the pattern
+    }
+    pattern.read_pos = 0;
+    pattern.pending = true;  // applied by core 0 main loop
+    return 0;
+  }
+
+  /// Command 89: read pattern status, multi-byte read: state (0: idle, 1: running, 2: done), bytes loaded or
+  /// captured, byte rate in Hz (4 bytes each, LSB first)
+  static uint8_t __not_in_flash_func(cmd_pattern_status)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    uint32_t state = 0;
+
+    if (pattern.pending || port_pio_busy())
+    {
+      state = 1;
+    }
+    else if (pattern.mode != PATTERN_STOP && pattern.rate != 0)
+    {
+      state = 2;
+    }
+    put_le32(&ctx->tx_buf[0], state);
+    put_le32(&ctx->tx_buf[4], (pattern.mode & PATTERN_CAPTURE) ? port_pio_count() : pattern.len);
+    put_le32(&ctx->tx_buf[8], pattern.rate);
+    ctx->tx_len = 12;
+    ctx->tx_pos = 0;
+    return ctx->tx_len;
+  }
+
+  /// Command 97: start the capture of port 0 and port 1 in the mode of data, or stop it with data 0. The sampling
+  /// period is set by command 92 and 93 (us), the trigger Gpio by command 94. The samples are taken by core 1.
+  /// Refused while the PIO parallel port owns a port, from command 87 to 88.
+  static uint8_t __not_in_flash_func(cmd_capture_run)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    uint32_t period = (uint32_t)ctx->reg[93] << 8 | ctx->reg[92];
+    bool running = capture_running();
+
+    if (arg == CAPTURE_STOP)
+    {
+      capture.stop = running;  // done at next sample, the buffer is kept
+      return 0;
+    }
+    if (running || pattern_active() || period < CAPTURE_MIN_US || !core1_fifo_ready())
+    {
+      set_error(ctx, ERR_DATA);  // capture or PIO port in progress, period too short or core 1 busy
+      return 1;
+    }
+    capture.period = period;
+    capture.mode = arg;
+    capture.pin = ctx->reg[94];
+    capture.stop = false;
+    capture.read_pos = 0;
+    capture.state = CAPTURE_RUNNING;  // a second start is refused from now
+    sio_hw->fifo_wr = CAPTURE_START;  // core 1 FIFO interrupt
+    __sev();
+    return 0;
+  }
+
+  /// Command 98: read back the capture from the oldest sample, multi-byte read of up to 32 samples (2 bytes each:
+  /// port 0, port 1) from the last read position. Nothing is returned until the capture is done.
+  static uint8_t __not_in_flash_func(cmd_capture_get)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    uint32_t count = capture.count;
+    uint32_t first = count > CAPTURE_SIZE ? count - CAPTURE_SIZE : 0;  // oldest sample kept
+    uint32_t n = 0;
+
+    if (capture.state == CAPTURE_DONE && count - first > capture.read_pos)
+    {
+      n = count - first - capture.read_pos;
+      n = n > TX_BUF_SIZE / 2 ? TX_BUF_SIZE / 2 : n;
+    }
+    for (uint32_t i = 0; i < n; i++)
+    {
+      uint16_t sample = capture.buf[(first + capture.read_pos + i) & (CAPTURE_SIZE - 1)];
+
+      ctx->tx_buf[2 * i] = (uint8_t)sample;
+      ctx->tx_buf[2 * i + 1] = (uint8_t)(sample >> 8);
+    }
+    capture.read_pos += n;
+    ctx->tx_len = 2 * n;
+    ctx->tx_pos = 0;
+    return ctx->tx_len;
+  }
+
+  /// Command 99: read capture status, multi-byte read: state (capture_state_t), samples in buffer, position of the
+  /// trigger sample in the buffer (0xFFFFFFFF if none), sampling period in us (4 bytes each, LSB first)
+  static uint8_t __not_in_flash_func(cmd_capture_status)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    uint32_t state = capture.state;
+    uint32_t count = capture.count;
+    uint32_t trigger = state != CAPTURE_IDLE ? capture.trigger : UINT32_MAX;
+    uint32_t first = count > CAPTURE_SIZE ? count - CAPTURE_SIZE : 0;
+
+    put_le32(&ctx->tx_buf[0], state);
+    put_le32(&ctx->tx_buf[4], count - first);
+    put_le32(&ctx->tx_buf[8], trigger != UINT32_MAX ? trigger - first : UINT32_MAX);
+    put_le32(&ctx->tx_buf[12], capture.period);
+    ctx->tx_len = 16;
+    ctx->tx_pos = 0;
+    return ctx->tx_len;
+  }
+
+  /// Command 03: append a byte to the sequence program, burst write to load the program
+  static uint8_t __not_in_flash_func(cmd_seq_load)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    if (seq.state == SEQ_RUNNING || seq.len >= SEQ_SIZE)
+    {
+      set_error(ctx, ERR_DATA);  // program full or in use
+      return 1;
+    }
+    seq.prog[seq.len++] = arg;
+    seq.state = SEQ_IDLE;
+    return 0;
+  }
+
+  /// Command 04: sequence control, 0: clear program, 1: run, 2: abort. Run and abort are sent to core 1.
+  static uint8_t __not_in_flash_func(cmd_seq_control)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    if (arg == 0)
+    {
+      if (seq.state == SEQ_RUNNING)
+      {
+        set_error(ctx, ERR_DATA);  // abort first
+        return 1;
+      }
+      seq.len = 0;
+      seq.state = SEQ_IDLE;
+      return 0;
+    }
+    if (!core1_fifo_ready())
+    {
+      set_error(ctx, ERR_DATA);  // core 1 busy with previous request
+      return 1;
+    }
+    if (arg == SEQ_RUN)
+    {
+      if (seq.state == SEQ_RUNNING)
+      {
+        set_error(ctx, ERR_DATA);  // already running
+        return 1;
+      }
+      seq.state = SEQ_RUNNING;  // program locked from now
+    }
+    sio_hw->fifo_wr = arg;  // core 1 FIFO interrupt
+    __sev();
+    return 0;
+  }
+
+  /// Command 05: read sequence status, multi-byte read: state, pc, program length, duration of last run in us
+  /// (4 bytes each, LSB first)
+  static uint8_t __not_in_flash_func(cmd_seq_status)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    put_le32(&ctx->tx_buf[0], seq.state);
+    put_le32(&ctx->tx_buf[4], seq.pc);
+    put_le32(&ctx->tx_buf[8], seq.len);
+    put_le32(&ctx->tx_buf[12], seq.duration);
+    ctx->tx_len = 16;
+    ctx->tx_pos = 0;
+    return ctx->tx_len;
+  }
+
+  #define SYNC_COMMIT 0x01   /**< Command 108 data: commit the shadow registers (command 76). */
+  #define SYNC_LATCH 0x02    /**< Command 108 data: latch the GPIO snapshot read by command 16. */
+  #define SYNC_RUN_SEQ 0x04  /**< Command 108 data: run the sequence loaded (command 04, 1). */
+
+  /// Command 108: synchronized actions, usually broadcast on the general call address to all slaves.
+  /// Data bits, executed in this order: commit the shadow registers, latch the snapshot, run the sequence.
+  static uint8_t __not_in_flash_func(cmd_sync)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    uint8_t result = 0;
+
+    if (arg & SYNC_COMMIT)
+    {
+      cmd_shadow_commit(ctx, 76, 0);
+    }
+    if (arg & SYNC_LATCH)
+    {
+      snapshot.input = gpio_get_all();
+      snapshot.dir = sio_hw->gpio_oe;
+      snapshot.latched = true;
+    }
+    if (arg & SYNC_RUN_SEQ)
+    {
+      result = cmd_seq_control(ctx, 4, SEQ_RUN);
+    }
+    return result;
+  }
+
+  /// Command 27 and 28: invert Gpio for the time of command 22 and 23 (27: us, 28: ms). With a cycle count set
+  /// by command 24, toggle Gpio for count periods of that time instead. The pulse is started by core 1.
+  static uint8_t __not_in_flash_func(cmd_pulse)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    uint32_t time = (uint32_t)ctx->reg[23] << 8 | ctx->reg[22];
+    uint cycles = ctx->reg[24];
+    uint slot = PULSE_SLOTS;
+
+    for (uint i = 0; i < PULSE_SLOTS; i++)
+    {
+      if (pulses[i].edges != 0 && pulses[i].pin == arg)
+      {
+        slot = PULSE_SLOTS;  // pin already pulsing
+        break;
+      }
+      if (pulses[i].edges == 0 && slot == PULSE_SLOTS)
+      {
+        slot = i;
+      }
+    }
+    time = cmd == 28 ? time * 1000 : time;
+    time = cycles ? time / 2 : time;  // two edges per period
+    if (slot == PULSE_SLOTS || time < PULSE_MIN_US || !core1_fifo_ready())
+    {
+      set_error(ctx, ERR_DATA);  // no free slot, time too short or core 1 busy
+      return 1;
+    }
+    pulses[slot].pin = arg;
+    pulses[slot].half = time;
+    pulses[slot].edges = cycles ? 2 * cycles : 2;  // slot in use from now
+    sio_hw->fifo_wr = PULSE_START | slot;          // core 1 FIFO interrupt
+    __sev();
+    return 0;
+  }
+
+  /// Command 29: stop the pulse of Gpio, the level before the pulse is restored by core 1
+  static uint8_t __not_in_flash_func(cmd_pulse_stop)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    if (!core1_fifo_ready())
+    {
+      set_error(ctx, ERR_DATA);  // core 1 busy with previous request
+      return 1;
+    }
+    sio_hw->fifo_wr = PULSE_STOP | arg;
+    __sev();
+    return 0;
+  }
+
+  /// Command 29: read Gpio pulsing, multi-byte read: one bit per Gpio (4 bytes, LSB first)
+  static uint8_t __not_in_flash_func(cmd_pulse_status)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    uint32_t mask = 0;
+
+    for (uint i = 0; i < PULSE_SLOTS; i++)
+    {
+      if (pulses[i].edges != 0)
+      {
+        mask |= 1u << pulses[i].pin;
+      }
+    }
+    put_le32(&ctx->tx_buf[0], mask);
+    ctx->tx_len = 4;
+    ctx->tx_pos = 0;
+    return ctx->tx_len;
+  }
+
+  /// Command 110: get timing of the command selected by data, multi-byte read: count, min, max, mean (4 bytes each)
+  static uint8_t __not_in_flash_func(cmd_get_timing)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    timing_t* t = &timing.cmd[arg];
+    put_le32(&ctx->tx_buf[0], t->count);
+    put_le32(&ctx->tx_buf[4], t->min);
+    put_le32(&ctx->tx_buf[8], t->max);
+    put_le32(&ctx->tx_buf[12], t->count ? t->sum / t->count : 0);
+    ctx->tx_len = 16;
+    ctx->tx_pos = 0;
+    return ctx->tx_len;
+  }
+
+  /// Command 111: get histogram selected by data (0: write, 1: read), multi-byte read: 16 buckets of 4 bytes
+  static uint8_t __not_in_flash_func(cmd_get_histogram)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    for (uint i = 0; i < TIMING_BUCKETS; i++)
+    {
+      put_le32(&ctx->tx_buf[i * 4], timing.histogram[arg][i]);
+    }
+    ctx->tx_len = TIMING_BUCKETS * 4;
+    ctx->tx_pos = 0;
+    return ctx->tx_len;
+  }
+
+  /// Command 112: clear timing statistics
+  static uint8_t __not_in_flash_func(cmd_clear_timing)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    timing_clear();
+    return 0;
+  }
+
+  /// Command 113: request a dump of timing statistics on serial port, done by core 1
+  static uint8_t __not_in_flash_func(cmd_dump_timing)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    timing.dump_request = true;
+    __sev();  // printed by the core 1 housekeeping loop
+    return 0;
+  }
+
+  /// Command 104: save the current gpio and pad configuration to flash, 105: erase it. Done by core 1
+  static uint8_t __not_in_flash_func(cmd_flash_config)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    if (flash_cfg.request != 0)
+    {
+      set_error(ctx, ERR_DATA);  // previous request in progress
+      return 1;
+    }
+    flash_cfg.state = CFG_BUSY;
+    flash_cfg.request = cmd == 104 ? CFG_SAVE : CFG_ERASE;
+    __sev();  // written by the core 1 housekeeping loop
+    return 0;
+  }
+
+  /// Command 104: get state of the flash configuration
+  static uint8_t __not_in_flash_func(cmd_get_flash_config)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    return flash_cfg.state;
+  }
+
+  /// Command 109: last command before the watchdog reset, multi-byte read: command, data. 0xFF 0xFF if none
+  static uint8_t __not_in_flash_func(cmd_get_watch_last)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    ctx->tx_buf[0] = watch.last >> 8;
+    ctx->tx_buf[1] = watch.last & 0xFF;
+    ctx->tx_len = 2;
+    ctx->tx_pos = 0;
+    return ctx->tx_len;
+  }
+
+  /// Command 106: read statistics, multi-byte read: time since clear in ms, transactions, bytes received, bytes sent,
+  /// Tx aborts, commands rejected, queue overflows, queue peak, events dropped, events peak (4 bytes each, LSB first)
+  static uint8_t __not_in_flash_func(cmd_get_stats)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    put_le32(&ctx->tx_buf[0], (time_us_32() - stats.start) / 1000);
+    put_le32(&ctx->tx_buf[4], stats.transactions);
+    put_le32(&ctx->tx_buf[8], stats.rx_bytes);
+    put_le32(&ctx->tx_buf[12], stats.tx_bytes);
+    put_le32(&ctx->tx_buf[16], stats.tx_aborts);
+    put_le32(&ctx->tx_buf[20], stats.rejected);
+    put_le32(&ctx->tx_buf[24], stats.queue_overflows);
+    put_le32(&ctx->tx_buf[28], stats.queue_peak);
+    put_le32(&ctx->tx_buf[32], stats.events_dropped);
+    put_le32(&ctx->tx_buf[36], stats.events_peak);
+    ctx->tx_len = 40;
+    ctx->tx_pos = 0;
+    return ctx->tx_len;
+  }
+
+  /// Command 107: clear statistics
+  static uint8_t __not_in_flash_func(cmd_clear_stats)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    memset(&stats, 0, sizeof(stats));
+    stats.start = time_us_32();
+    return 0;
+  }
+
+  /// Command 101: get code of the last error, error code and status command flag are cleared on read
+  static uint8_t __not_in_flash_func(cmd_get_error)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    uint8_t error = ctx->error;
+    ctx->error = ERR_NONE;
+    status.cmd = 0;
+    return error;
+  }
+
+  /// Command 102: get I2C speed mode in use
+  static uint8_t __not_in_flash_func(cmd_get_speed)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    return ctx->speed_mode;
+  }
+
+  /**
+   * @brief Command descriptor flags.
+   */
+  #define CMD_PIN_LIST 0x01   /**< On burst write, each extra data byte is one more gpio (or bank) for the same command. */
+  #define CMD_LOG_RESULT 0x02 /**< Read log format use only the result: (cmd, result) instead of (cmd, arg, result). */
+  #define CMD_NO_LOG 0x04     /**< Write not logged when accepted, used for data stream (pattern load). */
+  #define CMD_DMA_RX 0x08     /**< Data bytes of the transfer received by DMA, command executed once on Stop. */
+  #define CMD_NO_SEQ 0x10     /**< Command not allowed in a sequence program. */
+  #define CMD_BROADCAST 0x20  /**< Command accepted on the general call address. */
+
+  /**
+   * @brief Command groups, a command is valid when its group is in the personality of the I2C address.
+   */
+  #define CMD_GROUP_BASE 0x01 /**< GPIO, pad, sequence, status and diagnostic commands, used by all boards. */
+  #define CMD_GROUP_PORT 0x02 /**< 8 bit port and PIO pattern commands, IO slave (0x21) by default. */
+
+  /**
+   * @brief Board personality of a strap address. Generated in userconfig.h from the CMake cache variables
+   *        BOARD_20 to BOARD_23, the default of the board is applied at boot with a few masked writes.
+   */
+  typedef struct
+  {
+    uint8_t supported;   /// 0: I2C address not supported, status Bit 0 raised and GPIO left in reset state.
+    uint8_t groups;      /// Command groups accepted (CMD_GROUP_xxx).
+    uint32_t dir;        /// Direction of the GPIO_SET_DIR_MASK lines, 1 = Out.
+    uint32_t out;        /// Output value of the GPIO_SET_DIR_MASK lines.
+    uint32_t pull_up;    /// Pull-up of the GPIO_SET_DIR_MASK lines, 1 = active.
+    uint32_t pull_down;  /// Pull-down of the GPIO_SET_DIR_MASK lines, 1 = active.
+    uint8_t drive;       /// Drive strength of the GPIO_SET_DIR_MASK lines, same code as command 35.
+  } personality_t;
+
+  /**
+   * @brief Personality of the I2C addresses 0x20 to 0x23, indexed by the strap pins value.
+   */
+  static const personality_t PERSONALITIES[] = {BOARD_PERSONALITIES};
+
+  #define ARG_ANY 0xFF                    /**< Maximum data value, any data accepted. */
+  #define ARG_GPIO (NUM_BANK0_GPIOS - 1)  /**< Maximum data value for command using a gpio number. */
+
+  /**
+   * @brief Command action, called with the slave context, the command number and the data byte.
+   */
+  typedef uint8_t (*cmd_action_t)(slave_context_t* ctx, uint8_t cmd, uint8_t arg);
+
+  /**
+   * @brief Command descriptor. A command is writable when wr_fmt is defined, readable when read is defined.
+   *        The register of a command without read action is returned to master (readback of set value).
+   */
+  typedef struct
+  {
+    cmd_action_t write;  /// Action executed on each data byte written, NULL to only save data in register.
+    cmd_action_t read;   /// Action executed on read request, NULL to return the content of register.
+    const char* wr_fmt;  /// Log format of write: (cmd, arg, result). NULL if command is not writable.
+    const char* rd_fmt;  /// Log format of read: (cmd, arg, result) or (cmd, result) with CMD_LOG_RESULT.
+    uint8_t flags;       /// Command flags (CMD_xxx).
+    uint8_t group;       /// Command group, valid when in the personality of the I2C address (CMD_GROUP_xxx).
+    uint8_t arg_max;     /// Maximum value accepted for the data byte.
+  } cmd_desc_t;
+
+  /**
+   * @brief Command table indexed by command byte. Placed in RAM with the command actions, so the
+   *        command latency is fixed and never depends on XIP flash cache.
+   *        A new command is a new entry on this table.
+   */
+  static const cmd_desc_t __not_in_flash("cmd_table") cmd_table[CMD_TABLE_SIZE] = {
+      // clang-format off
+      //       write               read                   wr_fmt                                                    rd_fmt                                                flags                                                     group            arg_max
+      [1]   = {NULL,               cmd_get_version,       NULL,                                                     "Cmd %02d, MAJ Version: %02d ",                       CMD_LOG_RESULT,                                           CMD_GROUP_BASE,  ARG_ANY},
+      [2]   = {NULL,               cmd_get_version,       NULL,                                                     "Cmd %02d, MIN Version: %02d ",                       CMD_LOG_RESULT,                                           CMD_GROUP_BASE,  ARG_ANY},
+      [3]   = {cmd_seq_load,       NULL,                  "Cmd %02d, Sequence byte: 0x%02x ",                       NULL,                                                 CMD_PIN_LIST | CMD_NO_LOG | CMD_NO_SEQ,                   CMD_GROUP_BASE,  ARG_ANY},
+      [4]   = {cmd_seq_control,    NULL,                  "Cmd %02d, Sequence control: %01d ",                      NULL,                                                 CMD_NO_SEQ,                                               CMD_GROUP_BASE,  SEQ_ABORT},
+      [5]   = {NULL,               cmd_seq_status,        NULL,                                                     "Cmd %02d, Read sequence status: %02d bytes ",        CMD_LOG_RESULT,                                           CMD_GROUP_BASE,  ARG_ANY},
+      [10]  = {cmd_gpio_put,       NULL,                  "Cmd %02d, Clear Gpio: %02d ",                            NULL,                                                 CMD_PIN_LIST,                                             CMD_GROUP_BASE,  ARG_GPIO},
+      [11]  = {cmd_gpio_put,       NULL,                  "Cmd %02d, Set Gpio: %02d ",                              NULL,                                                 CMD_PIN_LIST,                                             CMD_GROUP_BASE,  ARG_GPIO},
+      [12]  = {cmd_clear_bank,     NULL,                  "Cmd %02d, Clear Bank Gpio: %02d ",                       NULL,                                                 CMD_PIN_LIST | CMD_BROADCAST,                             CMD_GROUP_BASE,  ARG_ANY},
+      [13]  = {NULL,               cmd_get_bank,          NULL,                                                     "Cmd %02d, Bank: %02d, read: 0x%01x ",                0,                                                        CMD_GROUP_BASE,  ARG_ANY},
+      [15]  = {NULL,               cmd_gpio_get,          NULL,                                                     "Cmd %02d, read True Gpio: %02d ,State: %01d ",       0,                                                        CMD_GROUP_BASE,  ARG_GPIO},
+      [16]  = {NULL,               cmd_get_snapshot,      NULL,                                                     "Cmd %02d, GPIO snapshot: %02d bytes ",               CMD_LOG_RESULT,                                           CMD_GROUP_BASE,  ARG_ANY},
+      [17]  = {cmd_debounce,       NULL,                  "Cmd %02d, Debounce time ms: %02d ",                      "Cmd %02d, Read debounce time: %02d ",                CMD_LOG_RESULT | CMD_NO_SEQ,                              CMD_GROUP_BASE,  ARG_ANY},
+      [18]  = {NULL,               cmd_gpio_get,          NULL,                                                     "Cmd %02d, read filtered Gpio: %02d ,State: %01d ",   0,                                                        CMD_GROUP_BASE,  ARG_GPIO},
+      [19]  = {NULL,               cmd_get_bank,          NULL,                                                     "Cmd %02d, Filtered Bank: %02d, read: 0x%01x ",       0,                                                        CMD_GROUP_BASE,  ARG_ANY},
+      [20]  = {cmd_gpio_dir,       NULL,                  "Cmd %02d, Set Dir Out Gpio: %02d ",                      NULL,                                                 CMD_PIN_LIST,                                             CMD_GROUP_BASE,  ARG_GPIO},
+      [21]  = {cmd_gpio_dir,       NULL,                  "Cmd %02d, Set dir In Gpio: %02d ",                       NULL,                                                 CMD_PIN_LIST,                                             CMD_GROUP_BASE,  ARG_GPIO},
+      [22]  = {NULL,               NULL,                  "Cmd %02d, Pulse time LSB: %02d ",                        NULL,                                                 0,                                                        CMD_GROUP_BASE,  ARG_ANY},
+      [23]  = {NULL,               NULL,                  "Cmd %02d, Pulse time MSB: %02d ",                        NULL,                                                 0,                                                        CMD_GROUP_BASE,  ARG_ANY},
+      [24]  = {NULL,               NULL,                  "Cmd %02d, Pulse cycles: %02d ",                          NULL,                                                 0,                                                        CMD_GROUP_BASE,  ARG_ANY},
+      [25]  = {NULL,               cmd_gpio_get_dir,      NULL,                                                     "Cmd %02d, Red Dir Gpio: %02d ,State: %01d ",         0,                                                        CMD_GROUP_BASE,  ARG_GPIO},
+      [26]  = {NULL,               cmd_get_pin_state,     NULL,                                                     "Cmd %02d, Read pin state: %02d bytes ",              CMD_LOG_RESULT,                                           CMD_GROUP_BASE,  ARG_ANY},
+      [27]  = {cmd_pulse,          NULL,                  "Cmd %02d, Pulse us Gpio: %02d ",                         NULL,                                                 CMD_PIN_LIST | CMD_NO_SEQ,                                CMD_GROUP_BASE,  ARG_GPIO},
+      [28]  = {cmd_pulse,          NULL,                  "Cmd %02d, Pulse ms Gpio: %02d ",                         NULL,                                                 CMD_PIN_LIST | CMD_NO_SEQ,                                CMD_GROUP_BASE,  ARG_GPIO},
+      [29]  = {cmd_pulse_stop,     cmd_pulse_status,      "Cmd %02d, Pulse stop Gpio: %02d ",                       "Cmd %02d, Read pulse status: %02d bytes ",           CMD_PIN_LIST | CMD_NO_SEQ | CMD_LOG_RESULT,               CMD_GROUP_BASE,  ARG_GPIO},
+      [30]  = {cmd_gpio_drive,     NULL,                  "Cmd %02d, 2mA Gpio: %02d ",                              NULL,                                                 CMD_PIN_LIST,                                             CMD_GROUP_BASE,  ARG_GPIO},
+      [31]  = {cmd_gpio_drive,     NULL,                  "Cmd %02d, 4mA Gpio: %02d ",                              NULL,                                                 CMD_PIN_LIST,                                             CMD_GROUP_BASE,  ARG_GPIO},
+      [32]  = {cmd_gpio_drive,     NULL,                  "Cmd %02d, 8mA Gpio: %02d ",                              NULL,                                                 CMD_PIN_LIST,                                             CMD_GROUP_BASE,  ARG_GPIO},
+      [33]  = {cmd_gpio_drive,     NULL,                  "Cmd %02d, 12mA Gpio: %02d ",                             NULL,                                                 CMD_PIN_LIST,                                             CMD_GROUP_BASE,  ARG_GPIO},
+      [35]  = {NULL,               cmd_gpio_get_drive,    NULL,                                                     "Cmd %02d, Read strenght Gpio: %02d ,State: %01d ",   0,                                                        CMD_GROUP_BASE,  ARG_GPIO},
+      [41]  = {cmd_gpio_pulls,     NULL,                  "Cmd %02d, Pull-up Gpio: %02d,  ",                        NULL,                                                 CMD_PIN_LIST,                                             CMD_GROUP_BASE,  ARG_GPIO},
+      [45]  = {NULL,               cmd_gpio_get_pull,     NULL,                                                     "Cmd %02d, read pull-up Gpio: %02d ,State: %01d ",    0,                                                        CMD_GROUP_BASE,  ARG_GPIO},
+      [50]  = {cmd_gpio_pulls,     NULL,                  "Cmd %02d, Clear pull-up, pull-down Gpio: %02d,  ",       NULL,                                                 CMD_PIN_LIST,                                             CMD_GROUP_BASE,  ARG_GPIO},
+      [51]  = {cmd_gpio_pulls,     NULL,                  "Cmd %02d, Pull-down Gpio: %02d,  ",                      NULL,                                                 CMD_PIN_LIST,                                             CMD_GROUP_BASE,  ARG_GPIO},
+      [55]  = {NULL,               cmd_gpio_get_pull,     NULL,                                                     "Cmd %02d, Read pull-down Gpio: %02d ,State: %01d ",  0,                                                        CMD_GROUP_BASE,  ARG_GPIO},
+      [56]  = {cmd_edge_enable,    NULL,                  "Cmd %02d, Edge notify enable Gpio: %02d ",               NULL,                                                 CMD_PIN_LIST,                                             CMD_GROUP_BASE,  ARG_GPIO},
+      [57]  = {cmd_edge_enable,    NULL,                  "Cmd %02d, Edge notify disable Gpio: %02d ",              NULL,                                                 CMD_PIN_LIST,                                             CMD_GROUP_BASE,  ARG_GPIO},
+      [58]  = {NULL,               cmd_get_changes,       NULL,                                                     "Cmd %02d, Read input changes: %02d bytes ",          CMD_LOG_RESULT,                                           CMD_GROUP_BASE,  ARG_ANY},
+      [60]  = {NULL,               NULL,                  "Cmd %02d, Pad State: %01d ",                             NULL,                                                 0,                                                        CMD_GROUP_BASE,  ARG_ANY},
+      [61]  = {cmd_gpio_pad,       NULL,                  "Cmd %02d, Set Pad State to Gpio: %02d ,State: 0x%01x ",  NULL,                                                 CMD_PIN_LIST,                                             CMD_GROUP_BASE,  ARG_GPIO},
+      [65]  = {NULL,               cmd_gpio_get_pad,      NULL,                                                     "Cmd %02d, Gpio: %02d ,Read PAD State: 0x%01x ",      0,                                                        CMD_GROUP_BASE,  ARG_GPIO},
+      [70]  = {cmd_shadow_put,     NULL,                  "Cmd %02d, Shadow Clear Gpio: %02d ",                     NULL,                                                 CMD_PIN_LIST,                                             CMD_GROUP_BASE,  ARG_GPIO},
+      [71]  = {cmd_shadow_put,     NULL,                  "Cmd %02d, Shadow Set Gpio: %02d ",                       NULL,                                                 CMD_PIN_LIST,                                             CMD_GROUP_BASE,  ARG_GPIO},
+      [72]  = {cmd_shadow_dir,     NULL,                  "Cmd %02d, Shadow Dir Out Gpio: %02d ",                   NULL,                                                 CMD_PIN_LIST,                                             CMD_GROUP_BASE,  ARG_GPIO},
+      [73]  = {cmd_shadow_dir,     NULL,                  "Cmd %02d, Shadow Dir In Gpio: %02d ",                    NULL,                                                 CMD_PIN_LIST,                                             CMD_GROUP_BASE,  ARG_GPIO},
+      [74]  = {cmd_shadow_port,    NULL,                  "Cmd %02d, Shadow Port0, 8 bit Out: 0x%02x ",             NULL,                                                 0,                                                        CMD_GROUP_PORT,  ARG_ANY},
+      [75]  = {NULL,               cmd_shadow_get,        NULL,                                                     "Cmd %02d, Read shadow: %02d bytes ",                 CMD_LOG_RESULT,                                           CMD_GROUP_BASE,  ARG_ANY},
+      [76]  = {cmd_shadow_commit,  NULL,                  "Cmd %02d, Commit shadow ",                               NULL,                                                 CMD_BROADCAST,                                            CMD_GROUP_BASE,  ARG_ANY},
+      [77]  = {cmd_shadow_load,    NULL,                  "Cmd %02d, Load shadow ",                                 NULL,                                                 CMD_BROADCAST,                                            CMD_GROUP_BASE,  ARG_ANY},
+      [78]  = {cmd_shadow_port,    NULL,                  "Cmd %02d, Shadow Port1, 8 bit Out: 0x%02x ",             NULL,                                                 0,                                                        CMD_GROUP_PORT,  ARG_ANY},
+      [80]  = {cmd_port_dir,       NULL,                  "Cmd %02d, Port0, dir: 0x%02x,  ",                        NULL,                                                 0,                                                        CMD_GROUP_PORT,  ARG_ANY},
+      [81]  = {cmd_port_put,       NULL,                  "Cmd %02d, Port0, 8 bit Out: 0x%02x,  ",                  NULL,                                                 0,                                                        CMD_GROUP_PORT,  ARG_ANY},
+      [82]  = {cmd_pattern_put,    cmd_pattern_get,       "Cmd %02d, Pattern load: %02d bytes ",                    "Cmd %02d, Read pattern: %02d bytes ",                CMD_PIN_LIST | CMD_NO_LOG | CMD_LOG_RESULT | CMD_DMA_RX,  CMD_GROUP_PORT,  ARG_ANY},
+      [83]  = {NULL,               NULL,                  "Cmd %02d, Pattern rate kHz LSB: %02d ",                  NULL,                                                 0,                                                        CMD_GROUP_PORT,  ARG_ANY},
+      [84]  = {NULL,               NULL,                  "Cmd %02d, Pattern rate kHz MSB: %02d ",                  NULL,                                                 0,                                                        CMD_GROUP_PORT,  ARG_ANY},
+      [85]  = {NULL,               cmd_port_get,          NULL,                                                     "Cmd %02d,Read Port0 8 bit In: 0x%01x ",              CMD_LOG_RESULT,                                           CMD_GROUP_PORT,  ARG_ANY},
+      [86]  = {NULL,               cmd_port_get,          NULL,                                                     "Cmd %02d, Read filtered Port0: 0x%01x ",             CMD_LOG_RESULT,                                           CMD_GROUP_PORT,  ARG_ANY},
+      [87]  = {cmd_pattern_run,    NULL,                  "Cmd %02d, Pattern start, mode: 0x%02x ",                 NULL,                                                 CMD_NO_SEQ,                                               CMD_GROUP_PORT,  0x0F},
+      [88]  = {cmd_pattern_run,    NULL,                  "Cmd %02d, Pattern stop ",                                NULL,                                                 CMD_NO_SEQ,                                               CMD_GROUP_PORT,  ARG_ANY},
+      [89]  = {NULL,               cmd_pattern_status,    NULL,                                                     "Cmd %02d, Read pattern status: %02d bytes ",         CMD_LOG_RESULT,                                           CMD_GROUP_PORT,  ARG_ANY},
+      [90]  = {cmd_port_dir,       NULL,                  "Cmd %02d, Port1, dir: 0x%02x,  ",                        NULL,                                                 0,                                                        CMD_GROUP_PORT,  ARG_ANY},
+      [91]  = {cmd_port_put,       NULL,                  "Cmd %02d, Port1, 8 bit Out: 0x%02x,  ",                  NULL,                                                 0,                                                        CMD_GROUP_PORT,  ARG_ANY},
+      [92]  = {NULL,               NULL,                  "Cmd %02d, Capture period us LSB: %02d ",                 NULL,                                                 0,                                                        CMD_GROUP_PORT,  ARG_ANY},
+      [93]  = {NULL,               NULL,                  "Cmd %02d, Capture period us MSB: %02d ",                 NULL,                                                 0,                                                        CMD_GROUP_PORT,  ARG_ANY},
+      [94]  = {NULL,               NULL,                  "Cmd %02d, Capture trigger Gpio: %02d ",                  NULL,                                                 0,                                                        CMD_GROUP_PORT,  ARG_GPIO},
+      [95]  = {NULL,               cmd_port_get,          NULL,                                                     "Cmd %02d, Read Port1 8 bit In: 0x%01x ",             CMD_LOG_RESULT,                                           CMD_GROUP_PORT,  ARG_ANY},
+      [96]  = {NULL,               cmd_port_get,          NULL,                                                     "Cmd %02d, Read filtered Port1: 0x%01x ",             CMD_LOG_RESULT,                                           CMD_GROUP_PORT,  ARG_ANY},
+      [97]  = {cmd_capture_run,    NULL,                  "Cmd %02d, Capture control: %01d ",                       NULL,                                                 CMD_NO_SEQ,                                               CMD_GROUP_PORT,  CAPTURE_FALLING},
+      [98]  = {NULL,               cmd_capture_get,       NULL,                                                     "Cmd %02d, Read capture: %02d bytes ",                CMD_LOG_RESULT,                                           CMD_GROUP_PORT,  ARG_ANY},
+      [99]  = {NULL,               cmd_capture_status,    NULL,                                                     "Cmd %02d, Read capture status: %02d bytes ",         CMD_LOG_RESULT,                                           CMD_GROUP_PORT,  ARG_ANY},
+      [100] = {NULL,               cmd_get_status,        NULL,                                                     "Cmd %02d,Status register: 0x%01x ",                  CMD_LOG_RESULT,                                           CMD_GROUP_BASE,  ARG_ANY},
+      [101] = {NULL,               cmd_get_error,         NULL,                                                     "Cmd %02d, Last error: %01d ",                        CMD_LOG_RESULT,                                           CMD_GROUP_BASE,  ARG_ANY},
+      [102] = {cmd_set_speed,      cmd_get_speed,         "Cmd %02d, I2C speed mode: %01d ",                        "Cmd %02d, Read I2C speed mode: %01d ",               CMD_LOG_RESULT | CMD_NO_SEQ,                              CMD_GROUP_BASE,  2},
+      [103] = {cmd_set_pec,        cmd_get_pec,           "Cmd %02d, PEC mode: %01d ",                              "Cmd %02d, Read PEC mode: %01d ",                     CMD_LOG_RESULT | CMD_NO_SEQ,                              CMD_GROUP_BASE,  1},
+      [104] = {cmd_flash_config,   cmd_get_flash_config,  "Cmd %02d, Save configuration to flash ",                 "Cmd %02d, Read flash configuration state: %01d ",    CMD_LOG_RESULT | CMD_NO_SEQ,                              CMD_GROUP_BASE,  ARG_ANY},
+      [105] = {cmd_flash_config,   NULL,                  "Cmd %02d, Erase configuration in flash ",                NULL,                                                 CMD_NO_SEQ,                                               CMD_GROUP_BASE,  ARG_ANY},
+      [106] = {NULL,               cmd_get_stats,         NULL,                                                     "Cmd %02d, Read statistics: %02d bytes ",             CMD_LOG_RESULT,                                           CMD_GROUP_BASE,  ARG_ANY},
+      [107] = {cmd_clear_stats,    NULL,                  "Cmd %02d, Clear statistics ",                            NULL,                                                 CMD_BROADCAST,                                            CMD_GROUP_BASE,  ARG_ANY},
+      [108] = {cmd_sync,           NULL,                  "Cmd %02d, Sync actions: 0x%02x ",                        NULL,                                                 CMD_BROADCAST | CMD_NO_SEQ,                               CMD_GROUP_BASE,  0x07},
+      [109] = {NULL,               cmd_get_watch_last,    NULL,                                                     "Cmd %02d, Read watchdog last cmd: %02d bytes ",      CMD_LOG_RESULT,                                           CMD_GROUP_BASE,  ARG_ANY},
+      [110] = {NULL,               cmd_get_timing,        NULL,                                                     "Cmd %02d, Read timing of Cmd: %02d ",                0,                                                        CMD_GROUP_BASE,  CMD_TABLE_SIZE - 1},
+      [111] = {NULL,               cmd_get_histogram,     NULL,                                                     "Cmd %02d, Read histogram: %01d ",                    0,                                                        CMD_GROUP_BASE,  TIMING_READ},
+      [112] = {cmd_clear_timing,   NULL,                  "Cmd %02d, Clear timing ",                                NULL,                                                 CMD_BROADCAST,                                            CMD_GROUP_BASE,  ARG_ANY},
+      [113] = {cmd_dump_timing,    NULL,                  "Cmd %02d, Dump timing ",                                 NULL,                                                 0,                                                        CMD_GROUP_BASE,  ARG_ANY},
+      // clang-format on
+  };
+
+  /**
+   * @brief Get the descriptor of a command
+   *
+   * @param cmd command number
+   * @return const cmd_desc_t* descriptor, NULL if the command number is outside of the table
+   */
+  static inline const cmd_desc_t* get_cmd_desc(uint8_t cmd)
+  {
+    return cmd < CMD_TABLE_SIZE ? &cmd_table[cmd] : NULL;
+  }
+
+  /**
+   * @brief Check the data byte of a write command: above the maximum of the command, or a gpio number of a
+   *        line of the second slave.
+   *
+   * @param desc command descriptor
+   * @param arg data byte
+   * @return true if the write is refused
+   */
+  static inline bool arg_refused(const cmd_desc_t* desc, uint8_t arg)
+  {
+    return arg > desc->arg_max || (desc->arg_max == ARG_GPIO && (slave1_mask() & 1u << arg));
+  }
+
+  /**
+   * @brief Check if a command byte received from master is supported. The command byte is used as register
+   *        address, so it is checked before any access to the register file.
+   *
+   * @param cmd command number
+   * @return true if the command is in table and can be written or read
+   */
+  static inline bool is_supported_cmd(uint8_t cmd)
+  {
+    const cmd_desc_t* desc = get_cmd_desc(cmd);
+    return desc != NULL && (desc->wr_fmt != NULL || desc->read != NULL);
+  }
+
+  /**
+   * @brief Start the DMA reception of a pattern load (command 82). The data bytes are written directly in the
+   *        pattern buffer, without interrupt, and the command is logged once at the end of the transfer.
+   *
+   * @param ctx slave context
+   * @param i2c I2C instance
+   * @return true if the data bytes are received by DMA, else the command is executed on each data byte
+   */
+  static bool __not_in_flash_func(pattern_dma_receive)(slave_context_t* ctx, i2c_inst_t* i2c)
+  {
+    const cmd_desc_t* desc = get_cmd_desc(ctx->reg_address);
+
+    if (!(desc->flags & CMD_DMA_RX) || !(desc->group & ctx->groups) || pattern.len >= PATTERN_SIZE)
+    {
+      return false;  // errors reported by the byte per byte path
+    }
+    return i2c_slave_dma_receive(i2c, &pattern.buf[pattern.len], PATTERN_SIZE - pattern.len);
+  }
+
+  /**
+   * @brief End of a pattern load received by DMA, bytes past the end of the pattern buffer are discarded.
+   *
+   * @param ctx slave context
+   * @param i2c I2C instance
+   */
+  static void __not_in_flash_func(pattern_dma_done)(slave_context_t* ctx, i2c_inst_t* i2c)
+  {
+    size_t received = i2c_slave_dma_received(i2c);
+    size_t avail = PATTERN_SIZE - pattern.len;
+
+    stats.rx_bytes += received;
+    if (received > avail)
+    {
+      set_error(ctx, ERR_DATA);  // pattern buffer full
+      received = avail;
+    }
+    pattern.len += received;
+    log_event(ctx->reg_address, (uint8_t)received, 0, EVT_WRITE);
+  }
+
+  /**
+   * @brief Save the output image and the last command executed in the watchdog scratch registers. Called after each
+   *        write command, from the I2C ISR or the sequence engine. An image torn by the other core fails the check
+   *        word and is not restored.
+   *
+   * @param cmd command number
+   * @param arg data byte
+   */
+  static void __not_in_flash_func(watch_save)(uint8_t cmd, uint8_t arg)
+  {
+    uint32_t out = sio_hw->gpio_out;
+    uint32_t dir = sio_hw->gpio_oe;
+    uint32_t last = ((uint32_t)cmd << 8) | arg;
+
+    watchdog_hw->scratch[1] = out;
+    watchdog_hw->scratch[2] = dir;
+    watchdog_hw->scratch[3] = last;
+    watchdog_hw->scratch[0] = WATCH_MAGIC ^ out ^ dir ^ last;
+  }
+
+  /**
+   * @brief Execute the write action of a command, after validation of I2C address and data.
+   *
+   * @param ctx slave context
+   * @param cmd command number
+   * @param arg data byte written by master
+   */
+  static void __not_in_flash_func(execute_write)(slave_context_t* ctx, uint8_t cmd, uint8_t arg)
+  {
+    const cmd_desc_t* desc = get_cmd_desc(cmd);
+    uint8_t result = 0;
+
+    if (desc == NULL || desc->wr_fmt == NULL)
+    {
+      return;  // data only saved in register, to be used by next read
+    }
+    if (!(desc->group & ctx->groups) || (ctx->broadcast && !(desc->flags & CMD_BROADCAST)))
+    {
+      set_error(ctx, ERR_ADDRESS);
+      log_event(cmd, arg, 0, EVT_WRITE | EVT_INVALID);
+      return;
+    }
+    if (arg_refused(desc, arg))
+    {  // gpio number out of range, ...
+      set_error(ctx, ERR_DATA);
+      log_event(cmd, arg, 0, EVT_WRITE | EVT_BAD_ARG);
+      return;
+    }
+    if (desc->write != NULL)
+    {
+      result = desc->write(ctx, cmd, arg);
+    }
+    watch_save(cmd, arg);
+    if (!(desc->flags & CMD_NO_LOG))
+    {
+      log_event(cmd, arg, result, EVT_WRITE);
+    }
+  }
+
+  /**
+   * @brief Execute the read action of a command, after validation of I2C address and data.
+   *        For command requesting a Get Value, the register is updated with the value to return.
+   *        For readback of Set value, the register is unchanged.
+   *
+   * @param ctx slave context
+   * @param cmd command number
+   * @return uint8_t event flags to log
+   */
+  static uint8_t __not_in_flash_func(execute_read)(slave_context_t* ctx, uint8_t cmd)
+  {
+    const cmd_desc_t* desc = get_cmd_desc(cmd);
+
+    if (desc == NULL || desc->read == NULL)
+    {
+      return EVT_READ;  // readback of register
+    }
+    if (!(desc->group & ctx->groups))
+    {
+      set_error(ctx, ERR_ADDRESS);
+      return EVT_READ | EVT_INVALID;
+    }
+    if (ctx->reg[cmd] > desc->arg_max)
+    {  // gpio number out of range, ...
+      set_error(ctx, ERR_DATA);
+      return EVT_READ | EVT_BAD_ARG;
+    }
+    ctx->reg[cmd] = desc->read(ctx, cmd, ctx->reg[cmd]);
+    return EVT_READ;
+  }
+
+  /**
+   * @brief Process one byte written by master: the command byte, or a data byte executing the command.
+   *
+   * @param ctx slave context
+   * @param i2c i2c instance used
+   * @param byte byte written by master
+   * @param start SysTick value at handler entry
+   * @return false if the rest of the transfer is received by DMA
+   */
+  static bool __not_in_flash_func(process_byte)(slave_context_t* ctx, i2c_inst_t* i2c, uint8_t byte, uint32_t start)
+  {
+    const cmd_desc_t* desc;
+    uint8_t cmd;  /// keep command value
+
+    if (!ctx->reg_address_written)  /// if command data already received
+    {
+      // writes always start with the memory address
+      ctx->reg_address = byte;  // Command byte
+      ctx->reg_address_written = true;
+      ctx->data_count = 0;
+      ctx->broadcast = i2c_slave_is_general_call(i2c);
+      ctx->cmd_rejected = !is_supported_cmd(ctx->reg_address);
+      if (ctx->cmd_rejected)
+      {
+        set_error(ctx, ERR_CMD);
+        log_event(ctx->reg_address, 0, 0, EVT_WRITE | EVT_BAD_CMD);
+        return true;
+      }
+      if (ctx->broadcast && !(get_cmd_desc(ctx->reg_address)->flags & CMD_BROADCAST))
+      {  // general call, data bytes are discarded (pattern load is never received by DMA)
+        ctx->cmd_rejected = true;
+        set_error(ctx, ERR_ADDRESS);
+        log_event(ctx->reg_address, 0, 0, EVT_WRITE | EVT_INVALID);
+        return true;
+      }
+      if (ctx->pec_frame)
+      {
+        return true;  // transfer already received, executed byte per byte on the Stop
+      }
+      return !pattern_dma_receive(ctx, i2c);  // bulk data of pattern load, no more receive event until Stop
+    }
+    if (ctx->cmd_rejected)
+    {  // data of a command not supported, discarded
+      return true;
+    }
+
+    // WRITE COMMAND
+    desc = get_cmd_desc(ctx->reg_address);
+    if (ctx->data_count > 0 && !(desc != NULL && (desc->flags & CMD_PIN_LIST)) &&
+        ctx->reg_address < sizeof(ctx->reg) - 1)
+    {  // burst write, auto-increment register pointer before the next data byte
+      ctx->reg_address++;
+    }
+    ctx->data_count++;
+    cmd = ctx->reg_address;
+    if (!is_supported_cmd(cmd))
+    {  // burst write reached a command not supported
+      ctx->cmd_rejected = true;
+      set_error(ctx, ERR_CMD);
+      log_event(cmd, 0, 0, EVT_WRITE | EVT_BAD_CMD);
+      return true;
+    }
+    ctx->reg[cmd] = byte;  // data Byte
+
+    execute_write(ctx, cmd, ctx->reg[cmd]);  /// Based on Command number, an action is executed
+    record_timing(cmd, TIMING_WRITE, start);
+    return true;
+  }
+
+  /**
+   * @brief End of a write in PEC mode, on Stop or Restart. The last byte is the PEC of the address and of the previous
+   *        bytes: when valid, the bytes are processed as a write without PEC. A single byte is the command of a read.
+   *
+   * @param ctx slave context
+   * @param i2c i2c instance used
+   * @param start SysTick value at handler entry
+   */
+  static void __not_in_flash_func(pec_receive_done)(slave_context_t* ctx, i2c_inst_t* i2c, uint32_t start)
+  {
+    uint len = ctx->pec_len;
+    uint8_t addr = i2c_slave_is_general_call(i2c) ? 0 : ctx->i2c_add << 1;
+    uint8_t crc;
+
+    ctx->pec_len = 0;
+    if (len == 1)
+    {  // command byte before a Restart, the PEC is at the end of the read
+      process_byte(ctx, i2c, ctx->pec_buf[0], start);
+      return;
+    }
+    if (len > PEC_BUF_SIZE)
+    {
+      set_error(ctx, ERR_DATA);  // write too long for PEC mode
+      log_event(ctx->pec_buf[0], 0, 0, EVT_WRITE | EVT_BAD_ARG);
+      return;
+    }
+    crc = crc8(crc8(0, &addr, 1), ctx->pec_buf, len - 1);
+    if (crc != ctx->pec_buf[len - 1])
+    {
+      set_error(ctx, ERR_PEC);  // corrupted transfer, nothing executed
+      log_event(ctx->pec_buf[0], ctx->pec_buf[len - 1], crc, EVT_WRITE | EVT_BAD_PEC);
+      return;
+    }
+    for (uint i = 0; i < len - 1; i++)
+    {
+      process_byte(ctx, i2c, ctx->pec_buf[i], start);
+    }
+  }
+
+  /**
+   * @brief End of a transfer, on Stop or Restart, or on the first data byte of the next write still in the Rx FIFO.
+   *
+   * @param ctx slave context
+   * @param i2c i2c instance used
+   * @param start SysTick value at handler entry
+   */
+  static void __not_in_flash_func(end_transfer)(slave_context_t* ctx, i2c_inst_t* i2c, uint32_t start)
+  {
+    stats.transactions++;
+    if (ctx->pec_len > 0)
+    {
+      pec_receive_done(ctx, i2c, start);
+    }
+    ctx->pec_frame = false;
+    ctx->reg_address_written = false;
+    ctx->broadcast = false;
+    ctx->tx_len = 0;  // end of multi-byte read
+  }
+
+  /**
+   * @brief Read one byte written by master from the Rx FIFO. In PEC mode, the bytes are kept until the Stop,
+   *        otherwise the byte is processed at once. The first data byte flag of the FIFO starts a new write: when
+   *        the Stop interrupt is late (core 0 locked out during a flash write), several short writes are
+   *        acknowledged by the hardware and wait in the FIFO, each one is ended before the next one starts.
+   *
+   * @param ctx slave context
+   * @param i2c i2c instance used
+   * @param start SysTick value at handler entry
+   * @return false if the rest of the transfer is received by DMA
+   */
+  static bool __not_in_flash_func(receive_byte)(slave_context_t* ctx, i2c_inst_t* i2c, uint32_t start)
+  {
+    uint32_t data = i2c_get_hw(i2c)->data_cmd;
+    uint8_t byte = (uint8_t)data;
+
+    stats.rx_bytes++;  // each call read one byte
+    if ((data & I2C_IC_DATA_CMD_FIRST_DATA_BYTE_BITS) && (ctx->reg_address_written || ctx->pec_len > 0))
+    {  // Stop or Restart of the previous write not handled yet
+      end_transfer(ctx, i2c, start);
+    }
+    if (!ctx->reg_address_written && ctx->pec_len == 0)
+    {  // first byte of the write, mode changed by command 103 applies from here
+      ctx->pec_frame = ctx->pec;
+    }
+    if (!ctx->pec_frame)
+    {
+      return process_byte(ctx, i2c, byte, start);
+    }
+    if (ctx->pec_len < PEC_BUF_SIZE)
+    {
+      ctx->pec_buf[ctx->pec_len] = byte;
+    }
+    if (ctx->pec_len < UINT8_MAX)
+    {
+      ctx->pec_len++;  // more than PEC_BUF_SIZE: transfer rejected on Stop
+    }
+    return true;
+  }
+
+  /**
+   * @brief Our handler is called from the I2C ISR, so it must complete quickly. Blocking calls
+   * printing to stdio may interfere with interrupt handling.
+   *
+   * @param i2c i2c instance used
+   * @param event interrupt from receive or transmit
+   */
+  static void __not_in_flash_func(i2c_slave_handler)(i2c_inst_t* i2c, i2c_slave_event_t event)
+  {
+    uint32_t start = systick_hw->cvr;  // entry time for timing statistics
+    slave_context_t* ctx = i2c == i2c1 ? &context1 : &context;  // each controller has its own registers
+    uint8_t cmd;    /// keep command value
+    uint8_t arg;    /// keep data byte written before a read
+    uint8_t flags;  /// event flags to log
+
+    switch (event)
+    {
+      case I2C_SLAVE_RECEIVE:  /// master has written some data, all bytes of Rx FIFO are processed
+        while (i2c_get_read_available(i2c) > 0 && receive_byte(ctx, i2c, start))
+        {
+        }
+        break;
+
+      case I2C_SLAVE_REQUEST:  // master is requesting data
+        if (ctx->tx_len > 0)
+        {  // multi-byte read in progress, refill Tx FIFO
+          send_tx_buf(ctx, i2c);
+          break;
+        }
+
+        cmd = ctx->reg_address;
+        if (!is_supported_cmd(cmd))
+        {  // register address out of range or not supported
+          i2c_write_byte(i2c, 0xFF);
+          stats.tx_bytes++;
+          set_error(ctx, ERR_CMD);
+          log_event(cmd, 0, 0xFF, EVT_READ | EVT_BAD_CMD);
+          break;
+        }
+        arg = ctx->reg[cmd];  // argument written by master before the read
+        flags = execute_read(ctx, cmd);
+
+        if (ctx->pec)
+        {  // response and its PEC sent from the Tx buffer
+          uint8_t result = ctx->tx_len > 0 ? ctx->tx_len : ctx->reg[cmd];
+          pec_append(ctx, cmd);
+          send_tx_buf(ctx, i2c);
+          log_event(cmd, arg, result, flags);
+        }
+        else if (ctx->tx_len > 0)
+        {  // multi-byte read
+          send_tx_buf(ctx, i2c);
+          log_event(cmd, arg, ctx->tx_len, flags);
+        }
+        else
+        {
+          i2c_write_byte(i2c, ctx->reg[cmd]);
+          stats.tx_bytes++;
+          log_event(cmd, arg, ctx->reg[cmd], flags);
+        }
+        record_timing(cmd, TIMING_READ, start);
+        break;
+
+      case I2C_SLAVE_TX_LOW:  // Tx FIFO low during a multi-byte read, refilled before the clock is stretched
+        if (ctx->tx_pos < ctx->tx_len)
+        {
+          send_tx_buf(ctx, i2c);
+        }
+        break;
+
+      case I2C_SLAVE_DMA_RECEIVE:  // bulk data received by DMA, before finish
+        pattern_dma_done(ctx, i2c);
+        record_timing(ctx->reg_address, TIMING_WRITE, start);
+        break;
+
+      case I2C_SLAVE_TX_ABORT:  // master NACK or Restart with data left in Tx FIFO
+        stats.tx_aborts++;
+        break;
+
+      case I2C_SLAVE_FINISH:  // master has signalled Stop / Restart
+        end_transfer(ctx, i2c, start);
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  /**
+   * @brief Convert a binary event from the ISR into a text message, using the log format of the
+   *        command table. Called on core 1 only, the text is written in place in the USB batch.
+   *
+   * @param evt Pointer to the event to format.
+   * @param buf Destination of the text.
+   * @param size Size of buf.
+   * @return size_t length of the text, without the terminating null
+   */
+  static size_t format_event(const EVENT* evt, char* buf, size_t size)
+  {
+    const cmd_desc_t* desc = get_cmd_desc(evt->cmd);
+    const char* fmt = NULL;
+    int len;
+
+    if (desc != NULL)
+    {
+      fmt = (evt->flags & EVT_WRITE) ? desc->wr_fmt : desc->rd_fmt;
+    }
+
+    if (evt->flags & EVT_INVALID)
+    {
+      len = snprintf(buf, size, "Cmd %02d, Not Valid for I2C Pico: 0x%02x,  ", evt->cmd, context.i2c_add);
+    }
+    else if (evt->flags & EVT_BAD_CMD)
+    {
+      len = snprintf(buf, size, "Cmd %02d, Command not supported ", evt->cmd);
+    }
+    else if (evt->flags & EVT_BAD_PEC)
+    {
+      len = snprintf(buf, size, "Cmd %02d, PEC error, received: 0x%02x, expected: 0x%02x ", evt->cmd, evt->arg, evt->result);
+    }
+    else if (evt->flags & EVT_BAD_ARG)
+    {
+      len = snprintf(buf, size, "Cmd %02d, Data not valid: %02d ", evt->cmd, evt->arg);
+    }
+    else if (fmt == NULL)
+    {  // no specific format
+      if (evt->flags & EVT_WRITE)
+      {
+        len = snprintf(buf, size, "Cmd %02d, Write: %02d ", evt->cmd, evt->arg);
+      }
+      else
+      {
+        len = snprintf(buf, size, "Read Cmd : %02d , Value: %02d ", evt->cmd, evt->result);
+      }
+    }
+    else if (!(evt->flags & EVT_WRITE) && (desc->flags & CMD_LOG_RESULT))
+    {
+      len = snprintf(buf, size, fmt, evt->cmd, evt->result);
+    }
+    else
+    {
+      len = snprintf(buf, size, fmt, evt->cmd, evt->arg, evt->result);
+    }
+    return len < 0 ? 0 : ((size_t)len >= size ? size - 1 : (size_t)len);
+  }
+
+  /**
+   * @brief function who read the 2 externals pins to define the I2C address to use.
+   *        The address = 0x20 + value of 2 externals pins
+   *
+   * @return uint8_t Address to use for the Pico slave
+   */
+  uint8_t read_i2c_address()
+  {
+    uint8_t io0, io1, I2C_address;
+
+    gpio_set_function(I2C_SLAVE_ADDRESS_IO0, GPIO_FUNC_SIO);  // Set mode to software IO Control
+    gpio_set_dir(I2C_SLAVE_ADDRESS_IO0, false);               // Set IO to input
+    gpio_pull_up(I2C_SLAVE_ADDRESS_IO0);                      // Set to pull-up
+
+    gpio_set_function(I2C_SLAVE_ADDRESS_IO1, GPIO_FUNC_SIO);  // Set mode to software IO Control
+    gpio_set_dir(I2C_SLAVE_ADDRESS_IO1, false);               // Set IO to input
+    gpio_pull_up(I2C_SLAVE_ADDRESS_IO1);                      // Set to pull-up
+    busy_wait_us_32(ADDRESS_SETTLE_US);                       // pull-up charging the pin capacitance
+
+    io0 = gpio_get(I2C_SLAVE_ADDRESS_IO0);
+    io1 = gpio_get(I2C_SLAVE_ADDRESS_IO1);
+    I2C_address = I2C_OFFSET_ADDRESS + (io1 << 1) + io0;
+    return I2C_address;
+  }
+
+  /**
+   * @brief Configure the slave timings and the SDA/SCL pads for the selected speed mode.
+   *        Fast-mode Plus needs the strongest drive and fast slew rate to meet the rise and fall time.
+   *
+   * @param ctx slave context
+   * @param mode index in I2C_SPEED_MODES
+   */
+  static void apply_i2c_speed(slave_context_t* ctx, uint8_t mode)
+  {
+    bool fm_plus = I2C_SPEED_MODES[mode] >= 1000000;
+
+    i2c_slave_set_speed(ctx->i2c, I2C_SPEED_MODES[mode]);
+
+    gpio_set_drive_strength(ctx->sda_pin, fm_plus ? GPIO_DRIVE_STRENGTH_12MA : GPIO_DRIVE_STRENGTH_4MA);
+    gpio_set_drive_strength(ctx->scl_pin, fm_plus ? GPIO_DRIVE_STRENGTH_12MA : GPIO_DRIVE_STRENGTH_4MA);
+    gpio_set_slew_rate(ctx->sda_pin, fm_plus ? GPIO_SLEW_RATE_FAST : GPIO_SLEW_RATE_SLOW);
+    gpio_set_slew_rate(ctx->scl_pin, fm_plus ? GPIO_SLEW_RATE_FAST : GPIO_SLEW_RATE_SLOW);
+    pin_state_update(ctx->sda_pin);
+    pin_state_update(ctx->scl_pin);
+    ctx->speed_mode = mode;
+  }
+
+  /**
+   * @brief Apply the speed mode requested by master with command 102, once the bus is idle.
+   *
+   * @param ctx slave context
+   */
+  static void update_i2c_speed(slave_context_t* ctx)
+  {
+    if (!ctx->speed_pending || (i2c_get_hw(ctx->i2c)->status & I2C_IC_STATUS_ACTIVITY_BITS))
+    {
+      return;  // nothing to do or transfer in progress
+    }
+    uint32_t irq_status = save_and_disable_interrupts();
+    ctx->speed_pending = false;
+    apply_i2c_speed(ctx, ctx->speed_request);
+    restore_interrupts(irq_status);
+  }
+  /**
+   * @brief Start or stop the PIO pattern requested by master with command 87 or 88. Pattern rate is set with
+   *        command 83 (kHz LSB) and 84 (kHz MSB).
+   */
+  static void update_pattern(void)
+  {
+    port_pio_config_t cfg;
+
+    if (!pattern.pending)
+    {
+      return;
+    }
+    pattern.pending = false;
+    if (pattern.mode == PATTERN_STOP)
+    {
+      port_pio_stop();
+      pattern.rate = 0;
+      return;
+    }
+
+    cfg.base_pin = (pattern.mode & PATTERN_PORT1) ? PORT1_OFFSET : 0;
+    cfg.capture = pattern.mode & PATTERN_CAPTURE;
+    cfg.strobe = pattern.mode & PATTERN_STROBE;
+    cfg.repeat = pattern.mode & PATTERN_REPEAT;
+    cfg.rate = (uint32_t)pattern.khz * 1000;
+    cfg.buf = pattern.buf;
+    cfg.len = cfg.capture ? PATTERN_SIZE : pattern.len;
+    if (cfg.len == 0)
+    {
+      port_pio_stop();
+      pattern.rate = 0;  // nothing to output
+      return;
+    }
+    pattern.rate = port_pio_start(&cfg);
+  }
+
+
+  /**
+   * @brief Edge interrupt of the pins enabled with command 56. The pin is latched as changed,
+   *        the status change flag is raised and the INT line is driven low until read by master.
+   *
+   * @param gpio pin number
+   * @param events edge detected
+   */
+  static void __not_in_flash_func(gpio_edge_callback)(uint gpio, uint32_t events)
+  {
+    edge.changed |= 1ul << gpio;
+    edge.time = time_us_32();
+    edge.count++;
+    status.change = 1;
+    #if I2C_SLAVE_INT_PIN >= 0
+        sio_hw->gpio_oe_set = 1ul << I2C_SLAVE_INT_PIN;  // open drain, output value is 0
+    #endif
+  }
+
+  /**
+   * @brief Setup the edge interrupt on core 0 and the optional INT line to master.
+   *        Edge interrupt of each pin is enabled later by command 56.
+   */
+  static void setup_edge_notify(void)
+  {
+    #if I2C_SLAVE_INT_PIN >= 0
+        gpio_init(I2C_SLAVE_INT_PIN);  // input, line released
+        gpio_put(I2C_SLAVE_INT_PIN, 0);
+        gpio_pull_up(I2C_SLAVE_INT_PIN);  // fail-safe, pull-up is on master side
+    #endif
+    gpio_set_irq_callback(gpio_edge_callback);
+    irq_set_enabled(IO_IRQ_BANK0, true);
+  }
+
+  /**
+   * @brief Set the up slave object. Each controller dispatch to the handler with its own context.
+   *
+   * @param ctx slave context, controller, pins and address defined
+   */
+  static void setup_slave(slave_context_t* ctx)
+  {
+    uint8_t mode;
+    gpio_init(ctx->sda_pin);
+    gpio_set_function(ctx->sda_pin, GPIO_FUNC_I2C);
+    gpio_pull_up(ctx->sda_pin);
+
+    gpio_init(ctx->scl_pin);
+    gpio_set_function(ctx->scl_pin, GPIO_FUNC_I2C);
+    gpio_pull_up(ctx->scl_pin);
+
+    i2c_init(ctx->i2c, I2C_BAUDRATE);
+
+    // configure controller for slave mode
+    i2c_slave_init(ctx->i2c, ctx->i2c_add, &i2c_slave_handler);
+    i2c_slave_set_fifo_thresholds(ctx->i2c, I2C_RX_THRESHOLD, I2C_TX_THRESHOLD);
+    i2c_slave_dma_init(ctx->i2c);  // bulk transfers by DMA, byte per byte if no channel available
+
+    for (mode = 0; mode < count_of(I2C_SPEED_MODES) - 1; mode++)
+    {  // select the mode matching the boot baudrate
+      if (I2C_SPEED_MODES[mode] >= I2C_BAUDRATE)
+      {
+        break;
+      }
+    }
+    apply_i2c_speed(ctx, mode);
+  }
+
+  #define LOG_BATCH_SIZE 1024 /**< Size of the buffer used to send the log messages to USB in one write. */
+  #define LED_ACTIVITY_MS 50   /**< Led OFF time to indicate log activity. */
+  #define LED_HEARTBEAT_MS 200 /**< Led OFF time for heartbeat. */
+  #define CORE1_ALARM_NUM 2    /**< Hardware alarm of the core 1 alarm pool. */
+  #define HOUSEKEEPING_MS 100  /**< Period of the core 1 housekeeping timer: watchdog and led heartbeat. */
+  #define HEARTBEAT_MSG_TICKS 150 /**< Housekeeping ticks between two heartbeat messages on serial port (15 s). */
+
+  static volatile alarm_id_t led_alarm;  // alarm used to turn ON the board led after a blink
+  static alarm_pool_t* core1_alarm_pool;  // alarms with callback running on core 1
+  static uint16_t heartbeat_pulse;        // number of housekeeping ticks between led heartbeat
+
+  /**
+   * @brief Periodic work of core 1, done by a repeating timer so the housekeeping loop sleeps until an event.
+   */
+  static struct
+  {
+    repeating_timer_t timer;      /// Housekeeping timer, on the core 1 alarm pool.
+    uint32_t alive;               /// Last value of the core 0 alive counter.
+    uint stall;                   /// Ticks without core 0 alive.
+    uint16_t led_ticks;           /// Ticks since the last led heartbeat.
+    uint16_t msg_ticks;           /// Ticks since the last heartbeat message.
+    volatile bool heartbeat_msg;  /// Heartbeat message to print by the housekeeping loop.
+  } housekeeping;
+
+  /**
+   * @brief Alarm callback turning back ON the board led at the end of a blink.
+   *
+   * @param id alarm id
+   * @param user_data not used
+   * @return int64_t 0, alarm is not rescheduled
+   */
+  static int64_t led_on_callback(alarm_id_t id, void* user_data)
+  {
+    gpio_put(PICO_DEFAULT_LED_PIN, 1);  // Turn ON board led
+    led_alarm = 0;
+    return 0;
+  }
+
+  /**
+   * @brief Turn OFF the board led and start an alarm to turn it back ON, the caller is never blocked.
+   *        A blink requested while another one is running extends the OFF time. Called from the housekeeping
+   *        loop and from the housekeeping timer on core 1, the alarm is replaced with interrupts disabled so a
+   *        caller never leaks the alarm of the other one.
+   *
+   * @param off_ms Time in ms where the led stays OFF
+   */
+  static void led_blink(uint32_t off_ms)
+  {
+    uint32_t irq_status = save_and_disable_interrupts();
+
+    if (led_alarm > 0)
+    {
+      alarm_pool_cancel_alarm(core1_alarm_pool, led_alarm);
+    }
+    gpio_put(PICO_DEFAULT_LED_PIN, 0);  // Turn OFF board led
+    led_alarm = alarm_pool_add_alarm_in_ms(core1_alarm_pool, off_ms, led_on_callback, NULL, true);
+    restore_interrupts(irq_status);
+  }
+
+  /**
+   * @brief Length of the sequence op at pc, including the op byte.
+   *
+   * @param pc position in program
+   * @return uint 0 if the op is not valid
+   */
+  static uint seq_op_length(uint pc)
+  {
+    uint8_t op = seq.prog[pc];
+    const cmd_desc_t* desc;
+    uint len = 2;
+
+    switch (op)
+    {
+      case SEQ_DELAY_US:
+      case SEQ_DELAY_MS:
+        len = 3;
+        break;
+
+      case SEQ_WAIT_HIGH:
+      case SEQ_WAIT_LOW:
+        len = 4;
+        if (pc + 1 < seq.len && seq.prog[pc + 1] > ARG_GPIO)
+        {
+          return 0;  // gpio out of range
+        }
+        break;
+
+      case SEQ_END:
+        len = 1;
+        break;
+
+      default:  // write command or register store (22-24, 60, 83, 84, 92-94): command, data
+        desc = get_cmd_desc(op);
+        if (desc == NULL || desc->wr_fmt == NULL || (desc->flags & CMD_NO_SEQ) || !(desc->group & context.groups) ||
+            (pc + 1 < seq.len && arg_refused(desc, seq.prog[pc + 1])))
+        {
+          return 0;
+        }
+        break;
+    }
+    return pc + len <= seq.len ? len : 0;
+  }
+
+  /**
+   * @brief Check the whole program before it is run, the position of the first invalid op is kept in pc.
+   *
+   * @return true program valid
+   */
+  static bool seq_check(void)
+  {
+    uint len;
+
+    for (uint pc = 0; pc < seq.len; pc += len)
+    {
+      len = seq_op_length(pc);
+      if (len == 0)
+      {
+        seq.pc = pc;
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * @brief End of the sequence, state and duration are updated.
+   *
+   * @param state final state
+   * @return int64_t 0, alarm is not rescheduled
+   */
+  static int64_t seq_stop(seq_state_t state)
+  {
+    seq.duration = time_us_32() - seq.start;
+    seq.alarm = 0;
+    seq.state = state;
+    return 0;
+  }
+
+  /**
+   * @brief Execute the sequence from pc until the next delay or input wait.
+   *
+   * @return int64_t time to the next step in us: negative from the end of the delay in progress (no drift),
+   *         positive from now (input polling), 0 at the end of the sequence
+   */
+  static int64_t __not_in_flash_func(seq_step)(void)
+  {
+    uint32_t delay;
+    uint8_t op;
+    uint pc = seq.pc;
+
+    while (pc < seq.len)
+    {
+      op = seq.prog[pc];
+      switch (op)
+      {
+        case SEQ_DELAY_US:
+        case SEQ_DELAY_MS:
+          delay = seq.prog[pc + 1] | (uint32_t)seq.prog[pc + 2] << 8;
+          delay = op == SEQ_DELAY_MS ? delay * 1000 : delay;
+          seq.pc = pc + 3;
+          if (delay < SEQ_BUSY_WAIT_US)
+          {
+            busy_wait_us_32(delay);  // alarm latency is longer than a short delay
+            break;
+          }
+          return -(int64_t)delay;
+
+        case SEQ_WAIT_HIGH:
+        case SEQ_WAIT_LOW:
+          if (gpio_get(seq.prog[pc + 1]) == (op == SEQ_WAIT_HIGH))
+          {
+            seq.deadline = 0;
+            seq.pc = pc + 4;
+            break;
+          }
+          if (seq.deadline == 0)
+          {
+            delay = seq.prog[pc + 2] | (uint32_t)seq.prog[pc + 3] << 8;
+            seq.deadline = time_us_64() + (uint64_t)delay * 1000;
+          }
+          else if (time_us_64() >= seq.deadline)
+          {
+            seq.deadline = 0;
+            return seq_stop(SEQ_TIMEOUT);  // pc on the wait op
+          }
+          seq.pc = pc;
+          return SEQ_POLL_US;
+
+        case SEQ_END:
+          seq.pc = seq.len;
+          break;
+
+        default:  // write command, checked before the run
+          context.reg[op] = seq.prog[pc + 1];  // data stored as for a write from master, parameter of a next command
+          if (get_cmd_desc(op)->write != NULL)
+          {
+            get_cmd_desc(op)->write(&context, op, seq.prog[pc + 1]);
+          }
+          watch_save(op, seq.prog[pc + 1]);
+          seq.pc = pc + 2;
+          break;
+      }
+      pc = seq.pc;
+    }
+    return seq_stop(SEQ_DONE);
+  }
+
+  /**
+   * @brief Alarm callback executing the next steps of the sequence.
+   *
+   * @param id alarm id
+   * @param user_data run number of the sequence started with this alarm
+   * @return int64_t next step, see seq_step()
+   */
+  static int64_t __not_in_flash_func(seq_alarm_callback)(alarm_id_t id, void* user_data)
+  {
+    if ((uint32_t)(uintptr_t)user_data != seq.run)
+    {
+      return 0;  // late alarm of an aborted run, seq.alarm belongs to the current run
+    }
+    return seq_step();
+  }
+
+  /**
+   * @brief Alarm callback making the next edge of a pulse.
+   *
+   * @param id alarm id
+   * @param user_data pulse slot
+   * @return int64_t time to the next edge, negative from the edge in progress (no drift), 0 after the last edge
+   */
+  static int64_t __not_in_flash_func(pulse_alarm_callback)(alarm_id_t id, void* user_data)
+  {
+    pulse_t* p = user_data;
+
+    sio_hw->gpio_togl = 1u << p->pin;
+    if (p->edges == 1)
+    {
+      p->alarm = 0;
+      p->edges = 0;  // slot free
+      return 0;
+    }
+    p->edges--;
+    return -(int64_t)p->half;
+  }
+
+  /**
+   * @brief Make the first edge of a pulse requested with command 27 or 28, then schedule the next one.
+   *
+   * @param p pulse slot, set by core 0
+   */
+  static void __not_in_flash_func(pulse_start)(pulse_t* p)
+  {
+    sio_hw->gpio_togl = 1u << p->pin;
+    p->edges--;
+    p->alarm = alarm_pool_add_alarm_in_us(core1_alarm_pool, p->half, pulse_alarm_callback, p, true);
+    if (p->alarm < 0)
+    {  // no alarm slot
+      sio_hw->gpio_togl = 1u << p->pin;
+      p->alarm = 0;
+      p->edges = 0;
+    }
+  }
+
+  /**
+   * @brief Stop the pulse of a gpio requested with command 29, the level before the pulse is restored.
+   *
+   * @param pin gpio
+   */
+  static void pulse_stop(uint pin)
+  {
+    for (uint i = 0; i < PULSE_SLOTS; i++)
+    {
+      pulse_t* p = &pulses[i];
+
+      if (p->edges != 0 && p->pin == pin && alarm_pool_cancel_alarm(core1_alarm_pool, p->alarm))
+      {
+        if (p->edges & 1)
+        {
+          sio_hw->gpio_togl = 1u << pin;  // output inverted
+        }
+        p->alarm = 0;
+        p->edges = 0;
+      }
+    }
+  }
 
-    gpio_init(PICO_DEFAULT_LED_PIN);
-    gpio_set_dir(PICO_DEFAULT_LED_PIN, GPIO_OUT);  // Configure Pico led board
-    gpio_put(PICO_DEFAULT_LED_PIN, 1);             // turn ON green led on Pico
+  /**
+   * @brief Alarm callback sampling the inputs of the debounce filter.
+   *
+   * @param id alarm id
+   * @param user_data not used
+   * @return int64_t next sample from the previous one, 0 when the filter is turned off
+   */
+  static int64_t __not_in_flash_func(debounce_alarm_callback)(alarm_id_t id, void* user_data)
+  {
+    uint32_t input = gpio_get_all();
+    uint32_t stable = debounce.stable;
+    uint window = debounce.window;
+
+    if (window == 0)
+    {
+      debounce.running = false;
+      return 0;
+    }
+    for (uint pin = 0; pin < NUM_BANK0_GPIOS; pin++)
+    {
+      uint count = debounce.count[pin];
+
+      count = (input & (1u << pin)) ? count + 1 : (count > 0 ? count - 1 : 0);
+      count = count > window ? window : count;  // window may be reduced while sampling
+      if (count == window)
+      {
+        stable |= 1u << pin;
+      }
+      else if (count == 0)
+      {
+        stable &= ~(1u << pin);
+      }
+      debounce.count[pin] = count;
+    }
+    debounce.stable = stable;
+    return -DEBOUNCE_SAMPLE_US;
+  }
+
+  /**
+   * @brief Start the input sampling requested with command 17, the filter starts from the current input value.
+   */
+  static void debounce_start(void)
+  {
+    uint32_t input = gpio_get_all();
+
+    if (debounce.running)
+    {
+      return;
+    }
+    for (uint pin = 0; pin < NUM_BANK0_GPIOS; pin++)
+    {
+      debounce.count[pin] = (input & (1u << pin)) ? debounce.window : 0;
+    }
+    debounce.stable = input;
+    debounce.running =
+        alarm_pool_add_alarm_in_us(core1_alarm_pool, DEBOUNCE_SAMPLE_US, debounce_alarm_callback, NULL, true) > 0;
+  }
+
+  /**
+   * @brief Alarm callback sampling port 0 and port 1 into the capture buffer, and checking the trigger edge.
+   *
+   * @param id alarm id
+   * @param user_data not used
+   * @return int64_t next sample from the previous one, 0 when the capture is done
+   */
+  static int64_t __not_in_flash_func(capture_alarm_callback)(alarm_id_t id, void* user_data)
+  {
+    uint32_t input = gpio_get_all();
+    uint32_t count = capture.count;
+
+    if (capture.stop)
+    {
+      capture.state = CAPTURE_DONE;  // stopped by master
+      return 0;
+    }
+    capture.buf[count & (CAPTURE_SIZE - 1)] =
+        (uint16_t)((input & PORT0_MASK) | ((input & PORT1_MASK) >> PORT1_OFFSET) << 8);
+    capture.count = ++count;
+
+    if (capture.state == CAPTURE_TRIGGERED)
+    {
+      if (count - capture.trigger >= CAPTURE_SIZE / 2)
+      {
+        capture.state = CAPTURE_DONE;  // half of the buffer before the trigger, half after
+        return 0;
+      }
+    }
+    else if (capture.mode != CAPTURE_RUN)
+    {
+      bool level = (input >> capture.pin) & 1u;
+
+      if (level != capture.level && level == (capture.mode == CAPTURE_RISING))
+      {
+        capture.trigger = count - 1;
+        capture.state = CAPTURE_TRIGGERED;
+      }
+      capture.level = level;
+    }
+    return -(int64_t)capture.period;
+  }
+
+  /**
+   * @brief Start the capture requested with command 97, the first sample is taken one period later.
+   */
+  static void capture_start(void)
+  {
+    capture.count = 0;
+    capture.trigger = UINT32_MAX;
+    capture.level = (gpio_get_all() >> capture.pin) & 1u;  // an edge is a change from the level at start
+    if (alarm_pool_add_alarm_in_us(core1_alarm_pool, capture.period, capture_alarm_callback, NULL, true) < 0)
+    {
+      capture.state = CAPTURE_DONE;  // no alarm slot, empty capture
+    }
+  }
+
+  /**
+   * @brief Core 1 FIFO interrupt: sequence run or abort requested by master with command 04, pulse start or stop
+   *        requested with command 27 to 29, input sampling requested with command 17, port capture requested
+   *        with command 97.
+   */
+  static void core1_fifo_irq_handler(void)
+  {
+    while (multicore_fifo_rvalid())
+    {
+      uint32_t request = sio_hw->fifo_rd;
+
+      if (request == DEBOUNCE_START)
+      {
+        debounce_start();
+        continue;
+      }
+      if (request == CAPTURE_START)
+      {
+        capture_start();
+        continue;
+      }
+      if (request & PULSE_START)
+      {
+        pulse_start(&pulses[request & 0xFF]);
+        continue;
+      }
+      if (request & PULSE_STOP)
+      {
+        pulse_stop(request & 0xFF);
+        continue;
+      }
+      uint32_t irq_status = save_and_disable_interrupts();  // the step callback cannot end the run meanwhile
+      if (seq.alarm > 0)
+      {  // sequence in progress is stopped first
+        alarm_pool_cancel_alarm(core1_alarm_pool, seq.alarm);
+        seq_stop(SEQ_ABORTED);
+      }
+      seq.run++;
+      restore_interrupts(irq_status);
+      if (request != SEQ_RUN)
+      {
+        seq.state = SEQ_ABORTED;
+        continue;
+      }
+
+      seq.state = SEQ_RUNNING;  // again, if the previous run was aborted just above
+      seq.pc = 0;
+      seq.deadline = 0;
+      seq.start = time_us_32();
+      if (!seq_check())
+      {
+        seq_stop(SEQ_ERROR);
+        continue;
+      }
+      irq_status = save_and_disable_interrupts();  // id saved before the first step can run
+      alarm_id_t alarm = alarm_pool_add_alarm_in_us(core1_alarm_pool, SEQ_POLL_US, seq_alarm_callback,
+                                                    (void*)(uintptr_t)seq.run, true);
+      if (alarm < 0)
+      {
+        seq_stop(SEQ_ERROR);  // no alarm slot
+      }
+      else if (seq.state == SEQ_RUNNING)
+      {
+        seq.alarm = alarm;  // not kept if the sequence is already completed
+      }
+      restore_interrupts(irq_status);
+    }
+    multicore_fifo_clear_irq();
+  }
+
+  /**
+   * @brief Setup the sequence engine and the pulses on core 1: FIFO interrupt from core 0 and alarm interrupt priority.
+   */
+  static void setup_sequence(void)
+  {
+    multicore_fifo_drain();
+    irq_set_exclusive_handler(SIO_IRQ_PROC1, core1_fifo_irq_handler);
+    irq_set_enabled(SIO_IRQ_PROC1, true);
+    irq_set_priority(TIMER_IRQ_0 + CORE1_ALARM_NUM, PICO_HIGHEST_IRQ_PRIORITY);  // not delayed by USB
+  }
 
-    // watchdog_enable(500, 1); // enable the watchdog
-    ctr = 0;
-    int mess = 0;
+  /**
+   * @brief Send all pending messages and events to the serial port. The text is collected into a buffer
+   *        and written in one go, without any delay between messages.
+   *
+   */
+  static void flush_log(void)
+  {
+    static char batch[LOG_BATCH_SIZE];
+    const char* msg;
+    uint32_t msg_len;
+    EVENT evt;
+    size_t len = 0;
+    bool sent = false;
+    bool connected = stdio_usb_connected();
+
+    if (!connected)
+    {
+      event_ring.tail = event_ring.head;  // nobody listening, drop events
+    }
 
     while (1)
-    {  // infinite loop, waiting for I2C command from Master
+    {
+      msg = ringbuf_peek(&log_queue, &msg_len);
+      if (msg != NULL)
+      {  // message copied once, from the queue to the batch
+        len += snprintf(&batch[len], sizeof(batch) - len, "Pico %02x: %.*s\n", context.i2c_add, (int)msg_len, msg);
+        ringbuf_release(&log_queue);
+      }
+      else if (connected && pop_event(&evt))
+      {  // text is formatted outside of ISR, directly in the batch
+        len += snprintf(&batch[len], sizeof(batch) - len, "Pico %02x: ", context.i2c_add);
+        len += format_event(&evt, &batch[len], MESSAGE_SIZE);
+        batch[len++] = '\n';
+      }
+      else
+      {
+        break;  // nothing left to send
+      }
+      sent = true;
+
+      if (sizeof(batch) - len < MESSAGE_SIZE + 16)
+      {  // no room for another message
+        fwrite(batch, 1, len, stdout);
+        len = 0;
+      }
+    }
+
+    if (len > 0)
+    {
+      fwrite(batch, 1, len, stdout);
+    }
+
+    if (sent)
+    {
+      fflush(stdout);
+      led_blink(LED_ACTIVITY_MS);  // activity indicator
+    }
+  }
+
+  /**
+   * @brief Print the ISR timing statistics on serial port, requested by command 113. Called on core 1.
+   *
+   */
+  static void dump_timing(void)
+  {
+    uint32_t hz = clock_get_hz(clk_sys);
+
+    printf("Pico %02x: ISR timing in cycles, clk_sys %lu Hz\n", context.i2c_add, (unsigned long)hz);
+    for (uint cmd = 0; cmd < CMD_TABLE_SIZE; cmd++)
+    {
+      timing_t t = timing.cmd[cmd];
+      if (t.count > 0)
+      {
+        printf("Pico %02x: Cmd %02d, count: %lu, min: %lu, max: %lu, mean: %lu\n", context.i2c_add, cmd, (unsigned long)t.count,
+               (unsigned long)t.min, (unsigned long)t.max, (unsigned long)(t.sum / t.count));
+      }
+    }
+    for (uint type = 0; type < 2; type++)
+    {
+      printf("Pico %02x: %s histogram:", context.i2c_add, type == TIMING_WRITE ? "Write" : "Read");
+      for (uint i = 0; i < TIMING_BUCKETS; i++)
+      {
+        printf(" %lu", (unsigned long)timing.histogram[type][i]);
+      }
+      printf("\n");
+    }
+  }
+
+  /**
+   * @brief Save or erase the flash configuration requested by master with command 104 or 105. Called on core 1,
+   *        core 0 is locked out during the flash write. Nothing feeds the watchdog while the flash is written (sector
+   *        erase up to 400 ms), so it is fed right before and after.
+   */
+  static void update_flash_config(void)
+  {
+    flash_config_t cfg;
+    int rc;
+
+    // requests sent before the flash request are executed first, the lockout handshake would discard them
+    irq_set_enabled(SIO_IRQ_PROC1, false);
+    core1_fifo_irq_handler();
+    irq_set_enabled(SIO_IRQ_PROC1, true);
+
+    watchdog_update();  // full timeout for the flash write, core 0 is alive as it sent the request
+    if (flash_cfg.request == CFG_SAVE)
+    {
+      cfg.i2c_add = context.i2c_add;
+      cfg.gpio_out = sio_hw->gpio_out;
+      cfg.gpio_dir = sio_hw->gpio_oe;
+      for (uint pin = 0; pin < NUM_BANK0_GPIOS; pin++)
+      {
+        cfg.pads[pin] = pads_bank0_hw->io[pin];
+      }
+      rc = flash_config_save(&cfg);
+      log_message("Configuration saved to flash, result: %d", rc);  // printed by next flush_log
+    }
+    else
+    {
+      rc = flash_config_erase();
+      log_message("Configuration erased in flash, result: %d", rc);
+    }
+    watchdog_update();
+
+    if (rc != PICO_OK)
+    {
+      flash_cfg.state = CFG_FAILED;
+    }
+    else
+    {
+      flash_cfg.state = flash_cfg.request == CFG_SAVE ? CFG_SAVED : CFG_ERASED;
+    }
+    flash_cfg.request = 0;
+  }
+
+  /**
+   * @brief Apply the configuration saved in flash, if any, for this I2C address. Called at boot, before the
+   *        I2C slave is started. Pads are restored first, so an output is never driven with the default pad setting.
+   *
+   * @return true saved configuration applied
+   */
+  static bool restore_flash_config(void)
+  {
+    flash_config_t cfg;
 
-      watchdog_update();
-      sleep_ms(10);
-      ctr++;
-      mess++;
+    if (!flash_config_load(&cfg) || cfg.i2c_add != context.i2c_add)
+    {
+      return false;  // nothing saved, or saved by a slave at another address
+    }
 
-      if (ctr > pulse)
+    for (uint pin = 0; pin < NUM_BANK0_GPIOS; pin++)
+    {
+      if (GPIO_BOOT_MASK & (1ul << pin))
       {
-        gpio_put(PICO_DEFAULT_LED_PIN, 0);  // Turn OFF board led
-        sleep_ms(200);
-        gpio_put(PICO_DEFAULT_LED_PIN, 1);  // Turn ON board led
-        ctr = 0;
+        pads_bank0_hw->io[pin] = cfg.pads[pin];
       }
-      if (mess > 1500)
+    }
+    gpio_put_masked(GPIO_SET_DIR_MASK, cfg.gpio_out);
+    gpio_set_dir_masked(GPIO_SET_DIR_MASK, cfg.gpio_dir);
+
+    flash_cfg.state = CFG_RESTORED;
+    return true;
+  }
+
+  /**
+   * @brief Restore the output image saved in the watchdog scratch registers before the watchdog reset,
+   *        so the relays are not dropped. Called at boot, after the default and flash configuration.
+   *
+   * @return true image valid and restored, the last command is in watch.last
+   */
+  static bool watch_restore(void)
+  {
+    uint32_t out = watchdog_hw->scratch[1];
+    uint32_t dir = watchdog_hw->scratch[2];
+    uint32_t last = watchdog_hw->scratch[3];
+
+    if (watchdog_hw->scratch[0] != (WATCH_MAGIC ^ out ^ dir ^ last))
+    {
+      return false;  // no write command before the reset, or image torn
+    }
+    gpio_put_masked(GPIO_SET_DIR_MASK, out);
+    gpio_set_dir_masked(GPIO_SET_DIR_MASK, dir);
+
+    watch.last = last;
+    return true;
+  }
+
+  /**
+   * @brief Core 0 alive timer, stopped when the I2C ISR or the core 0 interrupts are blocked.
+   *
+   * @param rt timer
+   * @return true always repeated
+   */
+  static bool __not_in_flash_func(watch_alive_callback)(repeating_timer_t* rt)
+  {
+    watch.core0_alive++;
+    return true;
+  }
+
+  /**
+   * @brief Housekeeping timer callback on core 1: feeds the watchdog while core 0 is alive, makes the led heartbeat
+   *        and requests the heartbeat message.
+   *
+   * @param rt repeating timer
+   * @return true, timer is rescheduled
+   */
+  static bool housekeeping_callback(repeating_timer_t* rt)
+  {
+    if (watch.core0_alive != housekeeping.alive)
+    {
+      housekeeping.alive = watch.core0_alive;
+      housekeeping.stall = 0;
+    }
+    if (housekeeping.stall++ < WATCH_STALL_TICKS)
+    {
+      watchdog_update();  // not fed when core 0 is hung, the slave is reset
+    }
+    if (++housekeeping.led_ticks > heartbeat_pulse)
+    {
+      led_blink(LED_HEARTBEAT_MS);  // heartbeat, led turned back ON by alarm
+      housekeeping.led_ticks = 0;
+    }
+    if (++housekeeping.msg_ticks > HEARTBEAT_MSG_TICKS)
+    {
+      housekeeping.heartbeat_msg = true;  // housekeeping loop woken up by the end of this interrupt
+      housekeeping.msg_ticks = 0;
+    }
+    return true;
+  }
+
+  /**
+   * @brief Core 1 entry. Runs the USB serial port, the log formatting, the led heartbeat and the watchdog feeding,
+   *        so the I2C response on core 0 is never delayed by USB enumeration or printing.
+   *        Events from the I2C ISR are received through the lock-free event ring, the loop sleeps between them.
+   */
+  static void core1_main(void)
+  {
+    core1_alarm_pool = alarm_pool_create(CORE1_ALARM_NUM, 16);  // alarm IRQ enabled on core 1, led, sequence, pulses and debounce
+    setup_sequence();
+    alarm_pool_add_repeating_timer_ms(core1_alarm_pool, HOUSEKEEPING_MS, housekeeping_callback, NULL, &housekeeping.timer);
+    core1_ready = true;  // boot completed for core 0, USB enumeration continue in background
+    stdio_init_all();
+
+    fprintf(stdout, "Slave Version: %d.%d\n", IO_SLAVE_VERSION_MAJOR, IO_SLAVE_VERSION_MINOR);
+
+    while (1)
+    {  // housekeeping loop, each request from core 0 or from the timer is signalled by an event or an interrupt
+
+      flush_log();  // send pending messages to serial port
+
+      if (housekeeping.heartbeat_msg)
       {
+        housekeeping.heartbeat_msg = false;
         // printf("i2c add: 0x%02x\n", context.i2c_add); // for debug only
         fprintf(stdout, "Heartbeat I2C Slave add: 0x%02x  version: %d.%d\n", context.i2c_add, IO_SLAVE_VERSION_MAJOR, IO_SLAVE_VERSION_MINOR);
-        mess = 0;
+      }
+
+      if (timing.dump_request)
+      {
+        timing.dump_request = false;
+        dump_timing();
+      }
+
+      if (flash_cfg.request != 0)
+      {
+        update_flash_config();
       }
 
       #ifdef USE_MASTER_LOOPBACK
-          // Need loopback on I2C
-          send_master(11, 28);     // test command when i2c loopback is used
-          send_master(15, 0x02);   // test command
-          send_master(85, 0xC0);   // test command
-          send_master(100, 0x00);  // test command
+          // Need loopback on I2C, slave_bench target
+          bench_run(context.i2c_add);  // one summary line per mix and baudrate, repeated forever as soak test
+      #else
+          __wfe();  // sleep until the next event (__sev() of a producer) or interrupt, no pending request is missed
       #endif
+    }
+  }
+
+  /**
+   * @brief Apply the default configuration of the board personality of the strap address: outputs, directions
+   *        and pads of the GPIO_SET_DIR_MASK lines, and command groups accepted by the slave.
+   *
+   * @param p personality of context.i2c_add
+   */
+  static void apply_personality(const personality_t* p)
+  {
+    context.groups = p->groups;
+    if (!p->supported)
+    {
+      status.cfg = 1;  // raise error flag
+      return;
+    }
+    gpio_put_masked(GPIO_SET_DIR_MASK, p->out);  // output value ready before line is driven
+    gpio_set_dir_masked(GPIO_SET_DIR_MASK, p->dir);
+    for (uint pin = 0; pin < NUM_BANK0_GPIOS; pin++)
+    {
+      if (GPIO_SET_DIR_MASK & (1u << pin))
+      {
+        gpio_set_pulls(pin, (p->pull_up >> pin) & 1, (p->pull_down >> pin) & 1);
+        gpio_set_drive_strength(pin, (enum gpio_drive_strength)p->drive);
+      }
+    }
+  }
+
+  /**
+   * @brief main loop to execute i2c command from master. Core 0 is dedicated to I2C, the USB serial port and
+   *        the housekeeping run on core 1. Pico les is flashing to indicate heartbeat
+   *
+   * @return int   do nothing
+   */
+  int main()
+  {
+    bool restored, recovered;
+
+    status.all_flags = 0;
+    heartbeat_pulse = 20;  // slow led flashing frequency
+
+    if (watchdog_caused_reboot())
+    {
+      status.watch = 1;
+      heartbeat_pulse = 5;  // fast flashing led to indicate watchdog trig
+    }
+
+    // Only what is needed to answer the master is done before the I2C slave is started,
+    // boot messages and USB serial port (core 1) come after.
+    gpio_init_mask(GPIO_BOOT_MASK);  // set which lines will be GPIO
+
+    context.i2c_add = read_i2c_address();                          // Setup I2C Address
+    apply_personality(&PERSONALITIES[context.i2c_add - I2C_OFFSET_ADDRESS]);  // Config following i2C Address
+
+    restored = restore_flash_config();  // configuration saved by master with command 104 replace the default
+    watch.last = WATCH_NO_LAST;
+    recovered = status.watch && watch_restore();  // outputs at the time of the watchdog reset
+
+    cmd_shadow_load(&context, 77, 0);  // shadow registers start from boot configuration
+    setup_edge_notify();               // input change notification, enabled per pin by master
+    port_pio_init();                   // PIO parallel port, started by master
+    pin_state_load();                  // pad bitmaps from boot configuration
+    timing_init();                     // cycle counter of core 0, used by ISR timing statistics
+
+    context.i2c = i2c0;
+    context.sda_pin = I2C_SLAVE_SDA_PIN;
+    context.scl_pin = I2C_SLAVE_SCL_PIN;
+    setup_slave(&context);  // first command from master accepted from here
+    #if I2C_SLAVE_GENERAL_CALL
+        i2c_slave_set_general_call(i2c0, true);  // broadcast commands to all slaves of the bus
+    #endif
+
+    #ifdef USE_I2C_SLAVE1
+        context1.i2c_add = I2C_SLAVE1_ADDRESS;
+        context1.groups = context.groups;  // same board, same commands as the strap address
+        context1.i2c = i2c1;
+        context1.sda_pin = I2C_SLAVE1_SDA_PIN;
+        context1.scl_pin = I2C_SLAVE1_SCL_PIN;
+        setup_slave(&context1);  // second master or bus segment, served in parallel
+    #endif
+
+    ringbuf_init(&log_queue, log_queue_buf, sizeof(log_queue_buf));  // initialise queue for serial message
+
+    log_message("Pico Slave boot for I2C address 0x%02x", context.i2c_add);
+    if (status.cfg)
+    {
+      log_message("I2C address not supported for device at address  0x%02x", context.i2c_add);
+    }
+    else
+    {
+      log_message("Config for I2C address 0x%02x completed", context.i2c_add);
+    }
+    if (restored)
+    {
+      log_message("Config for I2C address 0x%02x restored from flash", context.i2c_add);
+    }
+    #if I2C_SLAVE_GENERAL_CALL
+        log_message("Broadcast commands accepted on general call address");
+    #endif
+    #ifdef USE_I2C_SLAVE1
+        log_message("Second slave on i2c1 at address 0x%02x", context1.i2c_add);
+    #endif
+    if (recovered)
+    {
+      log_message("Outputs restored after watchdog reset, last Cmd %02d, data %02d", watch.last >> 8, watch.last & 0xFF);
+    }
+
+    #ifdef USE_MASTER_LOOPBACK
+        bench_setup_master();  // for development only, using loopback
+    #endif
+
+    gpio_init(PICO_DEFAULT_LED_PIN);
+    gpio_set_dir(PICO_DEFAULT_LED_PIN, GPIO_OUT);  // Configure Pico led board
+    gpio_put(PICO_DEFAULT_LED_PIN, 1);             // turn ON green led on Pico
+
+    flash_safe_execute_core_init();      // core 0 locked out by core 1 during flash configuration write
+    multicore_launch_core1(core1_main);  // USB serial port, log and housekeeping
+
+    add_repeating_timer_ms(WATCH_ALIVE_MS, watch_alive_callback, NULL, &watch.timer);  // core 0 alive for core 1
+    #ifndef USE_MASTER_LOOPBACK
+        watchdog_enable(WATCH_TIMEOUT_MS, 1);  // fed by core 1, not with benchmark run blocking the housekeeping loop
+    #endif
+
+    while (!core1_ready)
+    {
+      tight_loop_contents();  // sequence engine started on core 1
+    }
+    uint32_t irq_status = save_and_disable_interrupts();
+    status.ready = 1;  // status flags also written by the I2C ISR
+    restore_interrupts(irq_status);
+
+    while (1)
+    {  // infinite loop, I2C command from Master are executed by the ISR
+      update_i2c_speed(&context);   // apply speed change requested by master
+      update_i2c_speed(&context1);  // nothing pending if the second slave is not used
+      update_pattern();             // start or stop PIO pattern requested by master
 
-      while (deque(&rec))
+      irq_status = save_and_disable_interrupts();
+      if (!context.speed_pending && !context1.speed_pending && !pattern.pending)
       {
-        gpio_put(PICO_DEFAULT_LED_PIN, 0);                         // Turn OFF board led
-        printf("Pico %02x: %s\n", context.i2c_add, &rec.data[0]);  // send message to serial port
-        sleep_ms(50);
-        gpio_put(PICO_DEFAULT_LED_PIN, 1);  // Turn ON board led
+        __wfi();  // sleep until next interrupt, wake up even with interrupts disabled
       }
+      restore_interrupts(irq_status);
     }
   }